@@ -0,0 +1,701 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <atomic>
+#include <chrono>
+#include <istream>
+#include <string>
+
+/* Headless mode: main --batch [file] reads records from the file (mapped, see mapped.h) or stdin, one per line,
+       operation ; expression ; numbers
+   and writes one line per record,
+       record <tab> ok|error <tab> microseconds <tab> results
+   where the operations are
+       eval ; f(x) ; x1 x2 ...         f at every x
+       diff n ; f(x) ; x1 x2 ...       f^(n) at every x, or its text when no x is given (n defaults to 1)
+       roots ; f(x) ; a b [grid]       the roots of f in [a, b], see findRoots
+       slope ; F(x, y) ; x1 y1 ...     dy/dx of F(x, y) = 0 at every (x, y)
+   Blank lines and lines starting with # are skipped but still counted, so record numbers are line numbers.
+   Compiled expressions, their derivative programs and gradient tapes are kept in a set-associative cache keyed
+   by the expression text, so a file that repeats expressions parses each once while it is in the cache.
+   What records run is counted by reference, so it outlives its entry for as long as a record still needs it.
+   Numbers are written in the shortest form that reads back exactly (see writeNum), and all output goes through
+   one buffer (see graph.h).
+   main --table expression file [order] [--binary] evaluates f, f', ..., f^(order) at every number of the file,
+   as text or as a binary table (see binary.h); main --compile file writes the expressions of a file as a library,
+   and main --batch [file] --library library starts with them in the cache. With more than one thread (see
+   --threads n and threadCount) the records go through the pipeline of pipeline.h instead, with the same output. */
+
+/* compiled expressions kept by the batch mode, a power of two */
+const unsigned BATCH_CACHE_SIZE = 1024;
+/* entries an expression may go to; the least recently used of them is replaced */
+const unsigned BATCH_CACHE_WAYS = 4;
+/* highest derivative order a record may ask for */
+const unsigned BATCH_ORDER_MAX = 64;
+/* most grid cells a roots record may ask for; findRoots allocates one value per cell */
+const unsigned BATCH_GRID_MAX = 1 << 24;
+/* most threads --threads may ask for */
+const unsigned BATCH_THREADS_MAX = 1024;
+/* numbers tableFile parses and evaluates at a time, enough for every thread to get chunks */
+const unsigned TABLE_BLOCK = 1 << 20;
+
+/* something built once and only read afterwards, kept by every holder; the last to let go deletes it */
+template <class T>
+struct batchShared
+{
+    T value;
+    std::atomic<unsigned> refs;
+};
+
+/* The method moves value into a shared object with one holder. */
+template <class T>
+batchShared<T> *makeShared(T &&value)
+{
+    batchShared<T> *shared = new batchShared<T>;
+
+    shared->value = std::move(value);
+    shared->refs.store(1, std::memory_order_relaxed);
+    return shared;
+}
+
+template <class T>
+batchShared<T> *holdShared(batchShared<T> *shared)
+{
+    if (shared)
+        shared->refs.fetch_add(1, std::memory_order_relaxed);
+    return shared;
+}
+
+template <class T>
+void dropShared(batchShared<T> *shared)
+{
+    if (shared && shared->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        delete shared;
+}
+
+/* an expression and what has been built from it so far */
+struct batchEntry
+{
+    string text;
+    bool used;
+    unsigned long long stamp; // last use, for replacement
+    Expression expr;
+    array<batchShared<Program> *> programs; // programs[n] = f^(n), filled as far as asked
+    array<Expression> derivs; // derivs[n] = f^(n), simplified
+    batchShared<rootFinder> *finder; // NULL until a roots record asks
+    batchShared<gradTape> *tape; // NULL until a slope record asks
+};
+
+struct batchStats
+{
+    unsigned long long records;
+    unsigned long long errors;
+    unsigned long long hits;
+    unsigned long long misses;
+    double seconds;
+};
+
+/* The method returns the first entry of the set of entries text may go to. */
+unsigned batchSet(string_view text)
+{
+    unsigned hash = 2166136261u;
+    for (unsigned i = 0; i < text.length; i++)
+        hash = (hash ^ (unsigned char)text[i]) * 16777619u;
+    hash ^= hash >> 16; // FNV-1a leaves the low bits of similar texts alike
+
+    return hash & (BATCH_CACHE_SIZE - BATCH_CACHE_WAYS);
+}
+
+/* The method returns the entry of text in the cache, setting found, or else the entry it replaces: the least
+   recently used of the entries text may go to. */
+batchEntry &batchSlot(array<batchEntry> &cache, string_view text, bool &found)
+{
+    unsigned set = batchSet(text), oldest = set;
+
+    found = false;
+    for (unsigned i = set; i < set + BATCH_CACHE_WAYS; i++)
+    {
+        if (cache[i].used && cache[i].text.view() == text)
+        {
+            found = true;
+            return cache[i];
+        }
+
+        if (!cache[i].used || (cache[oldest].used && cache[i].stamp < cache[oldest].stamp))
+            oldest = i;
+    }
+
+    return cache[oldest];
+}
+
+/* The method sets a cache entry to a new expression, dropping what was built from the old one. */
+void batchFill(batchEntry &entry, string_view text, Expression &&expr, unsigned long long stamp)
+{
+    for (unsigned i = 0; i < entry.programs.length; i++)
+        dropShared(entry.programs[i]);
+    dropShared(entry.finder);
+    dropShared(entry.tape);
+
+    entry.text = text.toString();
+    entry.expr = std::move(expr);
+    entry.programs = array<batchShared<Program> *>();
+    entry.derivs = array<Expression>();
+    entry.finder = NULL;
+    entry.tape = NULL;
+    entry.used = true;
+    entry.stamp = stamp;
+}
+
+/* The method returns the cache entry of an expression, compiling it if it is not there. */
+batchEntry &batchLookup(array<batchEntry> &cache, string_view text, batchStats &stats)
+{
+    unsigned long long now = stats.hits + stats.misses;
+    bool found;
+    batchEntry &entry = batchSlot(cache, text, found);
+
+    if (found)
+    {
+        stats.hits++;
+        entry.stamp = now;
+        return entry;
+    }
+
+    stats.misses++;
+    entry.used = false; // until the new text compiles
+    batchFill(entry, text, compileExpr(text.toString(), true), now);
+
+    return entry;
+}
+
+/* The method fills the cache with the expressions of a library file (see binary.h), as if each had been used
+   once before the first record; a library larger than the cache keeps what fits last. */
+void batchPreload(array<batchEntry> &cache, const char *library)
+{
+    array<string> texts;
+    array<Expression> exprs;
+
+    loadLibrary(library, texts, exprs);
+    for (unsigned i = 0; i < exprs.length; i++)
+    {
+        bool found;
+        batchEntry &entry = batchSlot(cache, texts[i].view(), found);
+
+        batchFill(entry, texts[i].view(), std::move(exprs[i]), 0);
+    }
+}
+
+/* The method returns the program of f^(order), differentiating from the highest order built so far. */
+batchShared<Program> *batchProgram(batchEntry &entry, unsigned order)
+{
+    if (entry.derivs.length == 0)
+    {
+        Program prog = compileProgram(entry.expr); // throws on y before anything is kept
+
+        entry.derivs.push(entry.expr);
+        entry.programs.push(makeShared(std::move(prog)));
+    }
+
+    while (entry.derivs.length <= order)
+    {
+        Expression next = diffExpr(entry.derivs[entry.derivs.length - 1]);
+        next = simplifyExpr(next);
+
+        entry.programs.push(makeShared(compileProgram(next)));
+        entry.derivs.push(std::move(next));
+    }
+
+    return entry.programs[order];
+}
+
+/* The method reads a count given on the command line, a whole number from 0 to max; it throws error on
+   anything else. */
+unsigned batchCount(const char *text, unsigned max, const char *error)
+{
+    if (!isWholeNum(text, strlen(text)))
+        throw error;
+
+    double count = parseNum(text);
+    if (!(count >= 0 && count <= max && count == floor(count)))
+        throw error;
+
+    return (unsigned)count;
+}
+
+/* The method reads the numbers of a record, separated by spaces or commas; it throws on anything else. */
+void batchNumbers(string_view field, array<double> &numbers)
+{
+    unsigned i = 0;
+
+    while (i < field.length)
+    {
+        while (i < field.length && (field[i] == ' ' || field[i] == ',' || field[i] == '\t'))
+            i++;
+
+        unsigned start = i;
+        while (i < field.length && field[i] != ' ' && field[i] != ',' && field[i] != '\t')
+            i++;
+
+        if (i == start)
+            continue;
+        if (!isWholeNum(field.data + start, i - start))
+            throw "Bad record: not a number.";
+
+        numbers.push(parseNum(field.slice(start, i)));
+    }
+}
+
+/* The method trims spaces from both ends of a view. */
+string_view batchTrim(string_view field)
+{
+    unsigned begin = 0, end = field.length;
+
+    while (begin < end && (field[begin] == ' ' || field[begin] == '\t'))
+        begin++;
+    while (end > begin && (field[end - 1] == ' ' || field[end - 1] == '\t' || field[end - 1] == '\r'))
+        end--;
+
+    return field.slice(begin, end);
+}
+
+/* The method appends a number to the results of a record, after a space unless it is the first. */
+void batchNumber(string &results, double value)
+{
+    if (results.length)
+        results += ' ';
+    writeNum(results, value);
+}
+
+/* what a record asks for */
+enum batchKind
+{
+    BATCH_VALUES, // f^(order) at every number
+    BATCH_TEXT,   // f^(order) as text
+    BATCH_ROOTS,
+    BATCH_SLOPE
+};
+
+/* a record taken apart; batchPrepare points it at what batchRun needs in the cache, and holdJob keeps that
+   alive after the entry is replaced */
+struct batchJob
+{
+    batchKind kind;
+    unsigned order;
+    unsigned grid; // cells of a roots record
+    string_view expression; // within the record
+    array<double> numbers;
+    batchShared<Program> *prog;
+    batchShared<rootFinder> *finder;
+    batchShared<gradTape> *tape;
+};
+
+/* The method takes a record apart into job; it throws on a bad record. Nothing is compiled yet. */
+void batchParse(string_view line, batchJob &job)
+{
+    int first = line.indexOf(';'), second = first < 0 ? -1 : line.indexOf(';', first + 1);
+    if (first < 0)
+        throw "Bad record: expected operation ; expression ; numbers.";
+    if (second < 0) // no numbers
+        second = line.length;
+
+    string_view op = batchTrim(line.slice(0, first));
+
+    job.expression = batchTrim(line.slice(first + 1, second));
+    job.numbers = array<double>();
+    job.order = 0;
+    job.grid = ROOT_GRID;
+    job.prog = NULL;
+    job.finder = NULL;
+    job.tape = NULL;
+
+    if ((unsigned)second < line.length)
+        batchNumbers(line.slice(second + 1), job.numbers);
+
+    if (op == "eval" || op.startsWith("diff"))
+    {
+        if (op.startsWith("diff"))
+        {
+            string_view order = batchTrim(op.slice(4));
+
+            job.order = 1;
+            if (order.length > 0)
+            {
+                for (unsigned i = 0; i < order.length; i++)
+                {
+                    if (order.length > 2 || !isDecimalDigit(order[i]))
+                        throw "Bad record: diff needs an order from 0 to 64.";
+                }
+
+                job.order = (unsigned)parseNum(order);
+                if (job.order > BATCH_ORDER_MAX)
+                    throw "Bad record: diff needs an order from 0 to 64.";
+            }
+        }
+
+        job.kind = job.numbers.length == 0 && job.order > 0 ? BATCH_TEXT : BATCH_VALUES;
+    }
+    else if (op == "roots")
+    {
+        if (job.numbers.length < 2 || job.numbers.length > 3)
+            throw "Bad record: roots needs a b [grid].";
+        if (!std::isfinite(job.numbers[0]) || !std::isfinite(job.numbers[1]))
+            throw "Bad record: roots needs a finite interval.";
+
+        job.grid = ROOT_GRID;
+        if (job.numbers.length == 3)
+        {
+            double grid = job.numbers[2];
+
+            if (!(grid >= 1 && grid <= BATCH_GRID_MAX) || grid != floor(grid))
+                throw "Bad record: the roots grid must be a whole number from 1 to 16777216.";
+            job.grid = (unsigned)grid;
+        }
+
+        job.kind = BATCH_ROOTS;
+    }
+    else if (op == "slope")
+    {
+        if (job.numbers.length % 2)
+            throw "Bad record: slope needs x y pairs.";
+
+        job.kind = BATCH_SLOPE;
+    }
+    else
+        throw "Bad record: unknown operation.";
+}
+
+/* The method looks the expression of a job up in the cache, builds what the job needs there and points the
+   job at it; the text of a derivative is written to results at once. It throws on a bad expression, so
+   everything that can be refused is refused here and batchRun only evaluates. */
+void batchPrepare(array<batchEntry> &cache, batchJob &job, string &results, batchStats &stats)
+{
+    batchEntry &entry = batchLookup(cache, job.expression, stats);
+
+    switch (job.kind)
+    {
+    case BATCH_VALUES:
+        job.prog = batchProgram(entry, job.order);
+        break;
+    case BATCH_TEXT:
+        batchProgram(entry, job.order);
+        results = exprToStr(entry.derivs[job.order]);
+        break;
+    case BATCH_ROOTS:
+        if (entry.finder == NULL)
+            entry.finder = makeShared(makeRootFinder(entry.expr)); // throws on y
+        job.finder = entry.finder;
+        break;
+    case BATCH_SLOPE:
+        if (entry.tape == NULL)
+        {
+            gradTape tape;
+
+            recordTape(tape, entry.expr);
+            entry.tape = makeShared(std::move(tape));
+        }
+        job.tape = entry.tape;
+        break;
+    }
+}
+
+/* The method keeps what a prepared job points at alive until dropJob, whatever happens to the cache meanwhile. */
+void holdJob(batchJob &job)
+{
+    holdShared(job.prog);
+    holdShared(job.finder);
+    holdShared(job.tape);
+}
+
+void dropJob(batchJob &job)
+{
+    dropShared(job.prog);
+    dropShared(job.finder);
+    dropShared(job.tape);
+    job.prog = NULL;
+    job.finder = NULL;
+    job.tape = NULL;
+}
+
+/* The method evaluates a prepared job into results. A slope job works in arena, grown as needed, or in the
+   tape's own when there is none; threads running jobs of one tape at once each bring their own. */
+void batchRun(batchJob &job, string &results, array<double> *arena = NULL)
+{
+    array<double> roots;
+
+    switch (job.kind)
+    {
+    case BATCH_VALUES:
+        for (unsigned i = 0; i < job.numbers.length; i++)
+            batchNumber(results, runProgram(job.prog->value, job.numbers[i]));
+        break;
+    case BATCH_TEXT:
+        break;
+    case BATCH_ROOTS:
+        // one thread: records are small, and starting threads for each would cost more than the record
+        findRoots(job.finder->value, job.numbers[0], job.numbers[1], roots, job.grid, 1);
+
+        for (unsigned i = 0; i < roots.length; i++)
+            batchNumber(results, roots[i]);
+        break;
+    case BATCH_SLOPE:
+    {
+        gradTape &tape = job.tape->value;
+
+        if (arena == NULL)
+            arena = &tape.arena;
+        arena->reserve(4 * tape.ops.length);
+        while (arena->length < 4 * tape.ops.length)
+            arena->push(0);
+
+        for (unsigned i = 0; i < job.numbers.length; i += 2)
+            batchNumber(results, implicitSlope(tape, &(*arena)[0], job.numbers[i], job.numbers[i + 1]));
+        break;
+    }
+    }
+}
+
+/* The method runs one record into results; it throws on a bad record. */
+void batchRecord(array<batchEntry> &cache, string_view line, string &results, batchStats &stats)
+{
+    batchJob job;
+
+    batchParse(line, job);
+    batchPrepare(cache, job, results, stats);
+    batchRun(job, results);
+}
+
+/* The method fills cache with empty entries, then with the expressions of library if there is one. */
+void makeBatchCache(array<batchEntry> &cache, const char *library)
+{
+    cache.reserve(BATCH_CACHE_SIZE);
+    for (unsigned i = 0; i < BATCH_CACHE_SIZE; i++)
+    {
+        batchEntry entry;
+        entry.used = false;
+        entry.finder = NULL;
+        entry.tape = NULL;
+        cache.push(std::move(entry));
+    }
+
+    if (library)
+        batchPreload(cache, library);
+}
+
+/* The method lets go of what the entries of cache hold; records still running keep their part. */
+void freeBatchCache(array<batchEntry> &cache)
+{
+    for (unsigned i = 0; i < cache.length; i++)
+    {
+        for (unsigned n = 0; n < cache[i].programs.length; n++)
+            dropShared(cache[i].programs[n]);
+        dropShared(cache[i].finder);
+        dropShared(cache[i].tape);
+    }
+    cache = array<batchEntry>();
+}
+
+/* The method runs every line nextLine(line) gives, writes the results to out and returns the counts and total time.
+   The cache starts with the expressions of library, if there is one. */
+template <class NextLine>
+batchStats runBatchLines(std::ostream &out, const char *library, NextLine nextLine)
+{
+    array<batchEntry> cache;
+    outBuffer *buffer = new outBuffer; // too large for the stack
+    batchStats stats = {0, 0, 0, 0, 0};
+    string_view line;
+    string results;
+    auto begin = std::chrono::steady_clock::now();
+
+    makeBatchCache(cache, library);
+
+    buffer->out = &out;
+    buffer->length = 0;
+
+    while (nextLine(line))
+    {
+        stats.records++;
+
+        if (batchTrim(line).length == 0 || line[0] == '#')
+            continue;
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = true;
+
+        results = "";
+        try
+        {
+            batchRecord(cache, line, results, stats);
+        }
+        catch (const char *error)
+        {
+            results = error;
+            ok = false;
+            stats.errors++;
+        }
+
+        double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+        bufferFormat(*buffer, "%llu\t%s\t%.2f\t", stats.records, ok ? "ok" : "error", micros);
+        bufferPut(*buffer, results, results.length);
+        bufferChar(*buffer, '\n');
+    }
+
+    bufferFlush(*buffer);
+    delete buffer;
+    freeBatchCache(cache);
+
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return stats;
+}
+
+/* The method runs every record of a stream, such as stdin. */
+batchStats runBatch(std::istream &in, std::ostream &out, const char *library = NULL)
+{
+    std::string text;
+
+    return runBatchLines(out, library, [&](string_view &line) {
+        if (!std::getline(in, text))
+            return false;
+
+        line = string_view(text.data(), text.size());
+        return true;
+    });
+}
+
+/* The method runs every record of a file, read in place from its mapping. */
+batchStats runBatchFile(const char *path, std::ostream &out, const char *library = NULL)
+{
+    mappedFile file;
+    mappedReader reader = {&file, 0};
+
+    mapFile(path, file);
+    batchStats stats = runBatchLines(out, library, [&](string_view &line) {
+        return nextLine(reader, line);
+    });
+    unmapFile(file);
+
+    return stats;
+}
+
+/* The method compiles every expression of a text file, one per line, into a library (see binary.h) for
+   --batch --library, and returns how many. Blank lines and lines starting with # are skipped. */
+unsigned compileLibrary(const char *path, std::ostream &out)
+{
+    mappedFile file;
+    mappedReader reader = {&file, 0};
+    array<string> texts;
+    array<Expression> exprs;
+    string_view line;
+
+    mapFile(path, file);
+    try
+    {
+        while (nextLine(reader, line))
+        {
+            string_view text = batchTrim(line);
+
+            if (text.length == 0 || text[0] == '#')
+                continue;
+
+            texts.push(text.toString());
+            exprs.push(compileExpr(texts[texts.length - 1], true));
+        }
+    }
+    catch (const char *)
+    {
+        unmapFile(file);
+        throw;
+    }
+    unmapFile(file);
+
+    saveLibrary(out, texts, exprs);
+    return exprs.length;
+}
+
+/* The method writes f(x), f'(x), ..., f^(order)(x) for every number x of a file and returns how many x.
+   Either way the columns are x, f, f', ..., f^(order): text is one line per x, separated by tabs, and binary is
+   a table (see binary.h). Numbers are parsed from the mapping a block at a time and evaluated on all threads
+   (see runProgramParallel). */
+unsigned long long tableFile(Expression &expr, const char *path, std::ostream &out, unsigned order = 0, bool binary = false)
+{
+    array<Program> programs;
+    Expression deriv = expr;
+    mappedFile file;
+    mappedReader reader = {&file, 0};
+    unsigned columns = order + 2;
+    unsigned long long total = 0;
+
+    if (order > BATCH_ORDER_MAX)
+        throw "The order of a table goes from 0 to 64.";
+
+    programs.push(compileProgram(deriv)); // throws before anything is allocated
+    for (unsigned n = 1; n <= order; n++)
+    {
+        deriv = diffExpr(deriv);
+        deriv = simplifyExpr(deriv);
+        programs.push(compileProgram(deriv));
+    }
+
+    mapFile(path, file);
+
+    outBuffer *buffer = binary ? NULL : new outBuffer;
+    double *x = new double[(size_t)columns * TABLE_BLOCK];
+    double **data = new double *[columns];
+
+    for (unsigned c = 0; c < columns; c++)
+        data[c] = x + (size_t)c * TABLE_BLOCK;
+
+    if (binary)
+        writeTableHeader(out, columns);
+    else
+    {
+        buffer->out = &out;
+        buffer->length = 0;
+    }
+
+    try
+    {
+        for (unsigned n; (n = nextNumbers(reader, x, TABLE_BLOCK)) > 0; total += n)
+        {
+            for (unsigned c = 1; c < columns; c++)
+                runProgramParallel(programs[c - 1], x, data[c], n);
+
+            if (binary)
+            {
+                writeTableBlock(out, data, columns, n);
+                continue;
+            }
+
+            for (unsigned i = 0; i < n; i++)
+            {
+                for (unsigned c = 0; c < columns; c++)
+                {
+                    bufferNum(*buffer, data[c][i]);
+                    bufferChar(*buffer, c + 1 < columns ? '\t' : '\n');
+                }
+            }
+        }
+
+        if (buffer)
+            bufferFlush(*buffer);
+    }
+    catch (...) // a bad number, or running out of memory or threads
+    {
+        unmapFile(file);
+        delete buffer;
+        delete[] data;
+        delete[] x;
+        throw;
+    }
+
+    unmapFile(file);
+    delete buffer;
+    delete[] data;
+    delete[] x;
+
+    if (!out)
+        throw "Cannot write the table.";
+
+    return total;
+}
+
+#endif
@@ -0,0 +1,279 @@
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+#include "klib.array.h"
+#include "klib.string.h"
+#include "klib.number.h"
+#include "expression.h"
+#include "bytecode.h"
+#include "simd.h"
+#include "parallel.h"
+#include "derivative.h"
+#include "simplify.h"
+#include "diffcache.h"
+#include "taylor.h"
+#include "tape.h"
+#include "terms.h"
+#include "calculation.h"
+
+/* Benchmarks of the parse, evaluate, differentiate and string/array layers, one JSON object per line:
+     {"bench": "readExpr", "corpus": "poly", "iterations": ..., "ns_per_op": ..., "allocs_per_op": ...,
+      "ops_per_sec": ..., "mb_per_sec": ...}
+   An op is one call on one item of the corpus, cycling through the corpus; operation, categorizeTerm and
+   cal(term) take the terms readExpr splits the corpus into, as they do in the program. Each benchmark runs at least
+   the minimum time (default 200 ms) after one untimed warm-up pass. mb_per_sec counts the input text
+   read, and is 0 where there is none. Allocations are counted by the operator new below.
+   Usage: bench [filter] [milliseconds], where only benchmarks whose name contains filter are run. */
+
+std::atomic<unsigned long long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+/* keeps results alive so the work is not optimized away */
+volatile double benchSink;
+
+struct benchOptions
+{
+    const char *filter;
+    double minimum; // seconds
+};
+
+/* a named list of inputs */
+struct corpus
+{
+    const char *name;
+    array<string> items;
+    unsigned long long bytes; // total text length of the items
+};
+
+corpus makeCorpus(const char *name, const char **texts, unsigned count)
+{
+    corpus c = {name, array<string>(), 0};
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        c.items.push(string(texts[i]));
+        c.bytes += c.items[i].length;
+    }
+
+    return c;
+}
+
+/* The method runs op(i) for i = 0, 1, 2, ... until the minimum time is spent, and prints one JSON line.
+   bytes is the text read per pass over items ops. */
+template <class Op>
+void runBench(benchOptions &options, const char *bench, const char *corpusName, unsigned items, unsigned long long bytes, Op op)
+{
+    if (options.filter && !strstr(bench, options.filter))
+        return;
+
+    for (unsigned i = 0; i < items; i++) // warm-up: caches, and allocations made once
+        op(i);
+
+    unsigned long long iterations = 0, batch = items, allocs = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+
+    while (elapsed < options.minimum)
+    {
+        for (unsigned long long k = 0; k < batch; k++)
+            op((unsigned)((iterations + k) % items));
+
+        iterations += batch;
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        batch *= 2;
+    }
+
+    allocs = allocations.load() - allocs;
+
+    double ns = elapsed * 1e9 / iterations;
+    double megabytes = (double)bytes * iterations / items / 1e6;
+
+    printf("{\"bench\": \"%s\", \"corpus\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, \"allocs_per_op\": %.2f, \"ops_per_sec\": %.0f, \"mb_per_sec\": %.2f}\n",
+           bench, corpusName, iterations, ns, (double)allocs / iterations, iterations / elapsed, megabytes / elapsed);
+    fflush(stdout);
+}
+
+/* The method runs the benchmarks that take a whole expression text. */
+void benchExpressions(benchOptions &options, corpus &c)
+{
+    array<Expression> compiled;
+    array<Program> programs;
+    array<string> terms;
+
+    for (unsigned i = 0; i < c.items.length; i++)
+    {
+        array<string> split = readExpr(c.items[i]);
+
+        compiled.push(compileExpr(c.items[i]));
+        programs.push(compileProgram(compiled[i]));
+        for (unsigned j = 0; j < split.length; j++)
+            terms.push(split[j]);
+    }
+
+    unsigned long long termBytes = 0;
+    for (unsigned i = 0; i < terms.length; i++)
+        termBytes += terms[i].length;
+
+    runBench(options, "readExpr", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        benchSink = readExpr(c.items[i]).length;
+    });
+
+    runBench(options, "operation", c.name, terms.length, termBytes, [&](unsigned i) {
+        benchSink = operation(terms[i]).length;
+    });
+
+    runBench(options, "categorizeTerm", c.name, terms.length, termBytes, [&](unsigned i) {
+        termComponents components;
+        components.categorizeTerm(terms[i]);
+        benchSink = components.n.length + components.u.length;
+    });
+
+    runBench(options, "compileExpr", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        benchSink = compileExpr(c.items[i]).root;
+    });
+
+    runBench(options, "cal", c.name, terms.length, termBytes, [&](unsigned i) {
+        benchSink = cal(terms[i], 0.7f);
+    });
+
+    runBench(options, "cal_expr", c.name, c.items.length, 0, [&](unsigned i) {
+        benchSink = cal(compiled[i], 0.7 + i * 1e-3);
+    });
+
+    runBench(options, "cal_program", c.name, c.items.length, 0, [&](unsigned i) {
+        benchSink = cal(programs[i], 0.7 + i * 1e-3);
+    });
+
+    // Diff on an empty cache measures differentiation itself, on diffCache the cached repeat
+    derivCache empty(0);
+    runBench(options, "Diff", c.name, c.items.length, 0, [&](unsigned i) {
+        Expression derivative = diffExpr(compiled[i], 1, empty);
+        benchSink = exprToStr(derivative).length;
+    });
+
+    runBench(options, "Diff_cached", c.name, c.items.length, 0, [&](unsigned i) {
+        benchSink = Diff(compiled[i], 'x').length;
+    });
+}
+
+/* The method runs parseNum over numbers as they appear in expressions, and Array::push. */
+void benchNumbers(benchOptions &options)
+{
+    const char *texts[] = {"3", "42", "3.14159", "0.001", "1e-07", "2.5e+10", "123456789", "0.5"};
+    corpus c = makeCorpus("numbers", texts, sizeof texts / sizeof *texts);
+
+    runBench(options, "parseNum", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        benchSink = parseNum(c.items[i]);
+    });
+
+    runBench(options, "Array::push", "1000 ints", 1, 0, [&](unsigned) {
+        array<int> numbers;
+        for (int k = 0; k < 1000; k++)
+            numbers.push(k);
+        benchSink = numbers[999];
+    });
+}
+
+/* The method runs the String operations the parsers lean on. */
+void benchContainers(benchOptions &options, corpus &c)
+{
+    runBench(options, "String::split", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        benchSink = c.items[i].split("+").length;
+    });
+
+    runBench(options, "String::replace", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        benchSink = c.items[i].replace(" ", "").length;
+    });
+
+    runBench(options, "String::slice", c.name, c.items.length, c.bytes / 2, [&](unsigned i) {
+        benchSink = c.items[i].slice(0, c.items[i].length / 2).length;
+    });
+
+    runBench(options, "String::+=", c.name, c.items.length, c.bytes, [&](unsigned i) {
+        string text = "";
+        for (unsigned k = 0; k < c.items[i].length; k++)
+            text += c.items[i][k];
+        benchSink = text.length;
+    });
+}
+
+/* The method builds a sum of count terms a*sin(bx)^2, a*x^b, a*ln(x+b) in turn. */
+string longSum(unsigned count)
+{
+    string text = "";
+
+    for (unsigned i = 0; i < count; i++)
+    {
+        char term[64];
+
+        if (i % 3 == 0)
+            snprintf(term, sizeof term, "%s%usin(%ux)^2", i ? " + " : "", i + 1, i + 2);
+        else if (i % 3 == 1)
+            snprintf(term, sizeof term, " - %ux^%u", i + 1, i % 7 + 2);
+        else
+            snprintf(term, sizeof term, " + %uln(x+%u)", i + 1, i + 2);
+
+        text += term;
+    }
+
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    benchOptions options = {argc > 1 ? argv[1] : NULL, argc > 2 ? atof(argv[2]) / 1000 : 0.2};
+
+    const char *polynomials[] = {"3x^2+2x-5", "x^3-6x^2+11x-6", "4x^4-3x^2+x-7", "2x^5-x^4+3x^3-x+1", "x^2-2", "5x-3"};
+    const char *trigChains[] = {"sin(cos(tan(sin(x))))", "sin(cos(sin(cos(sin(x^2)))))", "tan(sin(2x)+cos(3x))", "sec(x)tan(x)-csc(x)cot(x)", "sin(x)^2cos(ln(x+2))", "cos(sin(cos(sin(cos(x)))))"};
+    const char *sums[] = {NULL, NULL, NULL};
+
+    string sum10 = longSum(10), sum50 = longSum(50), sum200 = longSum(200);
+    sums[0] = sum10;
+    sums[1] = sum50;
+    sums[2] = sum200;
+
+    corpus corpora[] = {makeCorpus("poly", polynomials, 6), makeCorpus("trig", trigChains, 6), makeCorpus("sum", sums, 3)};
+
+    try
+    {
+        for (unsigned i = 0; i < 3; i++)
+            benchExpressions(options, corpora[i]);
+
+        benchNumbers(options);
+
+        for (unsigned i = 0; i < 3; i++)
+            benchContainers(options, corpora[i]);
+    }
+    catch (const char *error)
+    {
+        std::cerr << error << "\n";
+        return 1;
+    }
+
+    return 0;
+}
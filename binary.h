@@ -0,0 +1,233 @@
+#ifndef BINARY_H
+#define BINARY_H
+
+#include <cstring>
+#include <ostream>
+#include <stdint.h>
+
+/* Binary files, written in the byte order of the machine and read back through mapped.h.
+   A library keeps compiled expressions with their text, so formulas load without being parsed again:
+       "KEXP" version byteOrder count, then per expression
+       textLength text nodeCount root, nodeCount nodes of {value left right type 0}
+   where nodes are in the order of the DAG, children before parents (see Expression).
+   A table keeps columns of doubles, such as x, f(x), f'(x), ... :
+       "KTAB" version byteOrder columns, then blocks of {rows, columns x rows doubles}
+   One column of a block is contiguous, and every double sits at a multiple of 8 from the start of the
+   file, so a mapped table is read as arrays in place. Every field is a 32-bit unsigned or int except
+   values and rows, which are 64 bits. A file of another version or byte order is refused, not converted. */
+
+/* version written into, and required of, library and table files */
+const uint32_t BINARY_VERSION = 1;
+/* written as is; reads back as another number on a machine of the other byte order */
+const uint32_t BINARY_BYTE_ORDER = 0x01020304;
+
+/* The method writes the 16-byte header every binary file starts with. */
+void writeBinaryHeader(std::ostream &out, const char *magic, uint32_t count)
+{
+    uint32_t fields[3] = {BINARY_VERSION, BINARY_BYTE_ORDER, count};
+
+    out.write(magic, 4);
+    out.write((const char *)fields, sizeof fields);
+}
+
+/* The method checks the header of a mapped binary file and returns its count; it throws on a file of another kind. */
+uint32_t readBinaryHeader(mappedFile &file, const char *magic)
+{
+    uint32_t fields[3];
+
+    if (file.size < 16 || memcmp(file.data, magic, 4) != 0)
+        throw "Bad binary file: wrong kind of file.";
+
+    memcpy(fields, file.data + 4, sizeof fields);
+    if (fields[0] != BINARY_VERSION)
+        throw "Bad binary file: unknown version.";
+    if (fields[1] != BINARY_BYTE_ORDER)
+        throw "Bad binary file: written with the other byte order.";
+
+    return fields[2];
+}
+
+/* The method copies size bytes at the reader into data, and throws if the file ends first. */
+void readBinary(mappedReader &reader, void *data, size_t size)
+{
+    if (reader.file->size - reader.pos < size)
+        throw "Bad binary file: truncated.";
+
+    memcpy(data, reader.file->data + reader.pos, size);
+    reader.pos += size;
+}
+
+/* The method writes expressions and their texts as a library. Only the nodes reachable from each root are kept. */
+void saveLibrary(std::ostream &out, array<string> &texts, array<Expression> &exprs)
+{
+    writeBinaryHeader(out, "KEXP", exprs.length);
+
+    for (unsigned i = 0; i < exprs.length; i++)
+    {
+        Expression compact;
+        array<int> copied;
+
+        copied.reserve(exprs[i].nodes.length);
+        for (unsigned n = 0; n < exprs[i].nodes.length; n++)
+            copied.push(-1);
+        compact.root = compactNode(exprs[i], exprs[i].root, compact, copied);
+
+        uint32_t fields[3] = {texts[i].length, compact.nodes.length, (uint32_t)compact.root};
+
+        out.write((const char *)fields, sizeof(uint32_t));
+        out.write(texts[i], texts[i].length);
+        out.write((const char *)(fields + 1), 2 * sizeof(uint32_t));
+
+        for (unsigned n = 0; n < compact.nodes.length; n++)
+        {
+            exprNode &node = compact.nodes[n];
+            int32_t links[2] = {node.left, node.right};
+            uint32_t type[2] = {(uint32_t)node.type, 0};
+
+            out.write((const char *)&node.value, sizeof(double));
+            out.write((const char *)links, sizeof links);
+            out.write((const char *)type, sizeof type);
+        }
+    }
+
+    if (!out)
+        throw "Cannot write the library.";
+}
+
+/* The method appends the expressions of a library file, and their texts, to exprs and texts.
+   Every node is checked, so a damaged file throws instead of making an expression that cannot be evaluated. */
+void loadLibrary(const char *path, array<string> &texts, array<Expression> &exprs)
+{
+    mappedFile file;
+    mappedReader reader = {&file, 16};
+
+    mapFile(path, file);
+    try
+    {
+        uint32_t count = readBinaryHeader(file, "KEXP");
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t fields[3];
+            Expression expr;
+
+            readBinary(reader, fields, sizeof(uint32_t));
+            if (file.size - reader.pos < fields[0])
+                throw "Bad binary file: truncated.";
+
+            string text = string_view(file.data + reader.pos, fields[0]).toString();
+            reader.pos += fields[0];
+
+            readBinary(reader, fields + 1, 2 * sizeof(uint32_t));
+            if ((file.size - reader.pos) / 24 < fields[1] || fields[2] >= fields[1])
+                throw "Bad binary file: bad expression.";
+
+            for (uint32_t n = 0; n < fields[1]; n++)
+            {
+                double value;
+                int32_t links[2];
+                uint32_t type[2];
+
+                readBinary(reader, &value, sizeof value);
+                readBinary(reader, links, sizeof links);
+                readBinary(reader, type, sizeof type);
+
+                // a node only refers to nodes before it, and compacted nodes are distinct, so addNode keeps the order
+                if (type[0] > EXPR_Y || links[0] < -1 || links[1] < -1 || links[0] >= (int32_t)n || links[1] >= (int32_t)n)
+                    throw "Bad binary file: bad expression.";
+
+                bool binaryType = type[0] >= EXPR_ADD && type[0] <= EXPR_POW;
+                bool unaryType = type[0] >= EXPR_NEG && type[0] <= EXPR_LOG;
+
+                // an operation with an operand missing, or a constant or variable with one, cannot be evaluated
+                if ((links[0] >= 0) != (binaryType || unaryType) || (links[1] >= 0) != binaryType)
+                    throw "Bad binary file: bad expression.";
+
+                addNode(expr, (exprType)type[0], value, links[0], links[1]);
+            }
+
+            if (expr.nodes.length != fields[1])
+                throw "Bad binary file: bad expression.";
+
+            expr.root = fields[2];
+            texts.push(std::move(text));
+            exprs.push(std::move(expr));
+        }
+    }
+    catch (const char *)
+    {
+        unmapFile(file);
+        throw;
+    }
+
+    unmapFile(file);
+}
+
+/* The method writes the header of a table of columns columns. */
+void writeTableHeader(std::ostream &out, unsigned columns)
+{
+    writeBinaryHeader(out, "KTAB", columns);
+}
+
+/* The method writes a block of rows rows, column c taken from data[c]. */
+void writeTableBlock(std::ostream &out, const double *const *data, unsigned columns, uint64_t rows)
+{
+    out.write((const char *)&rows, sizeof rows);
+    for (unsigned c = 0; c < columns; c++)
+        out.write((const char *)data[c], rows * sizeof(double));
+}
+
+/* a mapped table, read a block at a time */
+struct tableReader
+{
+    mappedFile file;
+    mappedReader reader;
+    unsigned columns;
+};
+
+/* The method maps a table file and checks its header. */
+void openTable(const char *path, tableReader &table)
+{
+    mapFile(path, table.file);
+    table.reader.file = &table.file;
+    table.reader.pos = 16;
+
+    try
+    {
+        table.columns = readBinaryHeader(table.file, "KTAB");
+        if (table.columns == 0)
+            throw "Bad binary file: a table without columns.";
+    }
+    catch (const char *)
+    {
+        unmapFile(table.file);
+        throw;
+    }
+}
+
+/* The method points data at the first column of the next block, column c being data + c*rows, and returns
+   false at the end of the table. The block is read in place; it stays valid until the next call. */
+bool nextTableBlock(tableReader &table, const double *&data, uint64_t &rows)
+{
+    mappedReader &reader = table.reader;
+
+    if (reader.pos >= table.file.size)
+        return false;
+
+    readBinary(reader, &rows, sizeof rows);
+    if ((table.file.size - reader.pos) / sizeof(double) / table.columns < rows)
+        throw "Bad binary file: truncated.";
+
+    releaseMapped(table.file, reader.pos - sizeof rows); // the blocks before this one
+    data = (const double *)(table.file.data + reader.pos);
+    reader.pos += rows * table.columns * sizeof(double);
+
+    return true;
+}
+
+void closeTable(tableReader &table)
+{
+    unmapFile(table.file);
+}
+
+#endif
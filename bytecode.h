@@ -0,0 +1,359 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+/* deepest operand stack a program may use; runProgram keeps it on the C stack */
+const unsigned PROGRAM_STACK_MAX = 256;
+/* number of x values runProgramBatch pushes through each instruction at a time */
+const unsigned PROGRAM_BLOCK = 256;
+/* operands of an instruction (constant and slot indices) are below this, the bits left above the opcode */
+const unsigned PROGRAM_OPERAND_LIMIT = 1u << 24;
+
+/* opcodes of the stack machine, in the same order as exprType */
+enum opCode
+{
+    OP_CONST, // push constants[operand]
+    OP_X,     // push x
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_POW,
+    OP_NEG,
+    OP_SIN,
+    OP_COS,
+    OP_TAN,
+    OP_COT,
+    OP_SEC,
+    OP_CSC,
+    OP_LN,
+    OP_LOG,   // ln(top) / constants[operand]
+    OP_STORE, // slots[operand] = top, for a node shared by several parents
+    OP_LOAD   // push slots[operand]
+};
+
+/* a compiled expression as a flat program: instruction = opcode | operand << 8 */
+struct Program
+{
+    array<unsigned> code;
+    array<double> constants;
+    unsigned stackSize;
+    unsigned slotCount;
+};
+
+/* state of compileProgram: parents of each node, and the slot holding a shared node once computed */
+struct emitContext
+{
+    Expression *expr;
+    array<unsigned> parents;
+    array<int> slot;
+};
+
+void countParents(emitContext &ctx, int index)
+{
+    if (ctx.parents[index]++ > 0)
+        return; // children already counted on the first visit
+
+    exprNode &node = ctx.expr->nodes[index];
+    if (node.left >= 0)
+        countParents(ctx, node.left);
+    if (node.right >= 0)
+        countParents(ctx, node.right);
+}
+
+unsigned makeInstr(opCode op, unsigned operand)
+{
+    if (operand >= PROGRAM_OPERAND_LIMIT)
+        throw "Bad arithmetic expression: too large to compile.";
+
+    return op | (operand << 8);
+}
+
+/* The method emits the node in post order and returns the stack depth it needs.
+   A node with several parents is computed once, kept in a slot and loaded again by the others. */
+unsigned emitNode(Program &prog, emitContext &ctx, int index)
+{
+    if (ctx.slot[index] >= 0)
+    {
+        prog.code.push(makeInstr(OP_LOAD, ctx.slot[index]));
+        return 1;
+    }
+
+    Expression &expr = *ctx.expr;
+    exprNode &node = expr.nodes[index];
+    unsigned depth = 1;
+
+    switch (node.type)
+    {
+    case EXPR_CONST:
+        prog.constants.push(node.value);
+        prog.code.push(makeInstr(OP_CONST, prog.constants.length - 1));
+        break;
+    case EXPR_X:
+        prog.code.push(makeInstr(OP_X, 0));
+        break;
+    case EXPR_Y:
+        throw "Bad arithmetic expression: y is only defined for implicit functions.";
+    case EXPR_ADD:
+    case EXPR_SUB:
+    case EXPR_MUL:
+    case EXPR_DIV:
+    case EXPR_POW:
+    {
+        unsigned leftDepth = emitNode(prog, ctx, node.left);
+        unsigned rightDepth = emitNode(prog, ctx, node.right) + 1; // left is still on the stack
+
+        depth = leftDepth > rightDepth ? leftDepth : rightDepth;
+        prog.code.push(makeInstr(opCode(node.type), 0));
+    }
+    break;
+    case EXPR_LOG:
+        depth = emitNode(prog, ctx, node.left);
+        prog.constants.push(log(node.value));
+        prog.code.push(makeInstr(OP_LOG, prog.constants.length - 1));
+        break;
+    default: // unary
+        depth = emitNode(prog, ctx, node.left);
+        prog.code.push(makeInstr(opCode(node.type), 0));
+    }
+
+    if (ctx.parents[index] > 1 && node.type != EXPR_CONST && node.type != EXPR_X) // cheaper to redo than to load
+    {
+        ctx.slot[index] = prog.slotCount++;
+        prog.code.push(makeInstr(OP_STORE, ctx.slot[index]));
+    }
+
+    return depth;
+}
+
+/* The method flattens a compiled expression into a program for runProgram. */
+Program compileProgram(Expression &expr)
+{
+    Program prog;
+    emitContext ctx = {&expr, array<unsigned>(), array<int>()};
+
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+    {
+        ctx.parents.push(0);
+        ctx.slot.push(-1);
+    }
+    countParents(ctx, expr.root);
+
+    prog.slotCount = 0;
+    prog.stackSize = emitNode(prog, ctx, expr.root);
+
+    if (prog.stackSize > PROGRAM_STACK_MAX)
+        throw "Bad arithmetic expression: too deeply nested.";
+
+    return prog;
+}
+
+/* stack and slots of runProgram for programs that need more than PROGRAM_STACK_MAX, grown as needed, one per thread */
+thread_local array<double> programScratch;
+
+/* The method runs a program for one x; no recursion, and no allocation unless the program needs more than
+   PROGRAM_STACK_MAX stack entries and slots together and more than this thread has needed before. */
+double runProgram(Program &prog, double x)
+{
+    double local[PROGRAM_STACK_MAX];
+    unsigned size = prog.stackSize + prog.slotCount;
+
+    if (size > PROGRAM_STACK_MAX && programScratch.length < size)
+    {
+        programScratch.reserve(size);
+        while (programScratch.length < size)
+            programScratch.push(0);
+    }
+
+    double *stack = size <= PROGRAM_STACK_MAX ? local : &programScratch[0];
+    double *slots = stack + prog.stackSize;
+    double *top = stack - 1;
+    const unsigned *code = &prog.code[0];
+    const unsigned *end = code + prog.code.length;
+    const double *constants = prog.constants.length ? &prog.constants[0] : NULL;
+
+    for (; code != end; code++)
+    {
+        switch (*code & 0xff)
+        {
+        case OP_CONST:
+            *++top = constants[*code >> 8];
+            break;
+        case OP_X:
+            *++top = x;
+            break;
+        case OP_ADD:
+            top--;
+            top[0] = top[0] + top[1];
+            break;
+        case OP_SUB:
+            top--;
+            top[0] = top[0] - top[1];
+            break;
+        case OP_MUL:
+            top--;
+            top[0] = top[0] * top[1];
+            break;
+        case OP_DIV:
+            top--;
+            top[0] = top[0] / top[1];
+            break;
+        case OP_POW:
+            top--;
+            top[0] = pow(top[0], top[1]);
+            break;
+        case OP_NEG:
+            top[0] = -top[0];
+            break;
+        case OP_SIN:
+            top[0] = sin(top[0]);
+            break;
+        case OP_COS:
+            top[0] = cos(top[0]);
+            break;
+        case OP_TAN:
+            top[0] = tan(top[0]);
+            break;
+        case OP_COT:
+            top[0] = 1 / tan(top[0]);
+            break;
+        case OP_SEC:
+            top[0] = 1 / cos(top[0]);
+            break;
+        case OP_CSC:
+            top[0] = 1 / sin(top[0]);
+            break;
+        case OP_LN:
+            top[0] = log(top[0]);
+            break;
+        case OP_LOG:
+            top[0] = log(top[0]) / constants[*code >> 8];
+            break;
+        case OP_STORE:
+            slots[*code >> 8] = top[0];
+            break;
+        case OP_LOAD:
+            *++top = slots[*code >> 8];
+            break;
+        }
+    }
+
+    return stack[0];
+}
+
+/* The method runs a program over count x values. Each instruction is decoded once per block of
+   PROGRAM_BLOCK points and applied to the whole block, with the same arithmetic as runProgram. */
+void runProgramBatch(Program &prog, const double *x, double *result, unsigned count)
+{
+    double *stack = new double[(prog.stackSize + prog.slotCount) * PROGRAM_BLOCK];
+    double *slots = stack + prog.stackSize * PROGRAM_BLOCK;
+    const unsigned *begin = &prog.code[0];
+    const unsigned *end = begin + prog.code.length;
+    const double *constants = prog.constants.length ? &prog.constants[0] : NULL;
+
+    for (unsigned start = 0; start < count; start += PROGRAM_BLOCK)
+    {
+        unsigned n = count - start < PROGRAM_BLOCK ? count - start : PROGRAM_BLOCK;
+        const double *xs = x + start;
+        double *top = stack - PROGRAM_BLOCK; // one row of the stack per block
+
+        for (const unsigned *code = begin; code != end; code++)
+        {
+            double *a = top - PROGRAM_BLOCK, *b = top;
+
+            switch (*code & 0xff)
+            {
+            case OP_CONST:
+            {
+                double c = constants[*code >> 8];
+                top += PROGRAM_BLOCK;
+                for (unsigned i = 0; i < n; i++)
+                    top[i] = c;
+            }
+            break;
+            case OP_X:
+                top += PROGRAM_BLOCK;
+                for (unsigned i = 0; i < n; i++)
+                    top[i] = xs[i];
+                break;
+            case OP_ADD:
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = a[i] + b[i];
+                top = a;
+                break;
+            case OP_SUB:
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = a[i] - b[i];
+                top = a;
+                break;
+            case OP_MUL:
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = a[i] * b[i];
+                top = a;
+                break;
+            case OP_DIV:
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = a[i] / b[i];
+                top = a;
+                break;
+            case OP_POW:
+                for (unsigned i = 0; i < n; i++)
+                    a[i] = pow(a[i], b[i]);
+                top = a;
+                break;
+            case OP_NEG:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = -b[i];
+                break;
+            case OP_SIN:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = sin(b[i]);
+                break;
+            case OP_COS:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = cos(b[i]);
+                break;
+            case OP_TAN:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = tan(b[i]);
+                break;
+            case OP_COT:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = 1 / tan(b[i]);
+                break;
+            case OP_SEC:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = 1 / cos(b[i]);
+                break;
+            case OP_CSC:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = 1 / sin(b[i]);
+                break;
+            case OP_LN:
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = log(b[i]);
+                break;
+            case OP_LOG:
+            {
+                double lnBase = constants[*code >> 8];
+                for (unsigned i = 0; i < n; i++)
+                    b[i] = log(b[i]) / lnBase;
+            }
+            break;
+            case OP_STORE:
+                memcpy(slots + (*code >> 8) * PROGRAM_BLOCK, b, n * sizeof(double));
+                break;
+            case OP_LOAD:
+                top += PROGRAM_BLOCK;
+                memcpy(top, slots + (*code >> 8) * PROGRAM_BLOCK, n * sizeof(double));
+                break;
+            }
+        }
+
+        for (unsigned i = 0; i < n; i++)
+            result[start + i] = stack[i];
+    }
+
+    delete[] stack;
+}
+
+#endif
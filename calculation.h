@@ -131,7 +131,7 @@ double cal(string term, float x)
         }
         else if (var.n[i] == 's' || var.n[i] == 'c' || var.n[i] == 't') //x^{2sin(2x)}  //trigon
         {
-            string tfunc = var.n.slice(i, i + 3);
+            string_view tfunc = var.n.sliceView(i, i + 3);
             string u_n = "";
             int leftPar = 0, rightPar = 0;
             i + 4; //skip sin(
@@ -233,7 +233,7 @@ double cal(string term, float x)
     {
         if (var.u[i] == 's' || var.u[i] == 'c' || var.u[i] == 't') //3{sin(2x)}
         {
-            string tfunc = var.u.slice(i, i + 3);
+            string_view tfunc = var.u.sliceView(i, i + 3);
             string u_u = "";
             int leftPar = 0, rightPar = 0;
 
@@ -280,7 +280,7 @@ double cal(string term, float x)
     {
         if ((term[i] == 's' || term[i] == 'c' || term[i] == 't') && i + 4 < term.length) //trigon
         {
-            string tfunc = term.slice(i, i + 3);        // 3sin(2x)
+            string_view tfunc = term.sliceView(i, i + 3);        // 3sin(2x)
             if (tfunc == "sin")
                 result = a * sin(var_value.u);   
             else if (tfunc == "cos")
@@ -330,9 +330,45 @@ double cal(string term, float x)
     return result;
 }
 
+/* The method evaluates a compiled expression; no text is read, so it is cheap to call for many x. */
+double cal(Expression &expr, double x)
+{
+    return evalNode(expr, expr.root, x);
+}
+
+/* The method evaluates a compiled program; the fastest way to evaluate the same f(x) many times. */
+double cal(Program &prog, double x)
+{
+    return runProgram(prog, x);
+}
+
+/* The method evaluates a compiled program for count x values at once, writing result[i] = f(x[i]). */
+/* Note: the results are the same, bit for bit, as calling cal(prog, x[i]) for each point. */
+void cal(Program &prog, const double *x, double *result, unsigned count)
+{
+    runProgramBatch(prog, x, result, count);
+}
+
+/* The method is the batch cal() on the vector kernels of simd.h; see there for the accuracy of each function. */
+void calSimd(Program &prog, const double *x, double *result, unsigned count)
+{
+    runProgramSimd(prog, x, result, count);
+}
+
+/* The method is calSimd() spread over evalThreads threads (parallel.h); results do not depend on the thread count. */
+void calParallel(Program &prog, const double *x, double *result, unsigned count)
+{
+    runProgramParallel(prog, x, result, count);
+}
+
+/* The method calculates dy/dx of the implicit function t(x, y) = 0 at (x, y): -F_x/F_y from one gradient sweep. */
 float implCal(string t, float x, float y)
 {
-    ;
+    Expression F = compileExpr(t, true);
+    gradTape tape;
+
+    recordTape(tape, F);
+    return implicitSlope(tape, x, y);
 }
 
 #endif
\ No newline at end of file
@@ -1,10 +1,12 @@
 #ifndef DERIVATIVE_H
 #define DERIVATIVE_H
 
+typedef unsigned short uint2;
+
 string Diff(string term, char var) {
     array<string> u, trigon;
     array<uint2> trigonIndex, varIndex;
-    unit2 outerPair = 0; // for (...)(...)
+    uint2 outerPair = 0; // for (...)(...)
 
     for (uint2 i = 0; i < term.length; i++) {
         // find (type): position and #of x
@@ -13,7 +15,7 @@ string Diff(string term, char var) {
 
         // find (type): trigonometric function.
         else if ((term[i] == 's' || term[i] == 'c' || term[i] == 't') && i + 4 < term.length) {
-            string tfunc = term.slice(i, i + 3);
+            string_view tfunc = term.sliceView(i, i + 3);
 
             if (tfunc == "sin" || tfunc == "cos" || tfunc == "tan" || tfunc == "csc" || tfunc == "sec" || tfunc == "cot") {
 
@@ -35,10 +37,10 @@ string Diff(string term, char var) {
                         tempU += term[i++];
                     }
 
-                    u.push(tfunc + tempU);
+                    u.push(tfunc.toString() + tempU);
                 }
                 else { // find: a*sin(u) or a*sin^1(u)
-                    trigon.push(tfunc);
+                    trigon.push(tfunc.toString());
 
                     i += 4; // skip 'sin(...'
                     while (i < term.length && (term[i] != ')' || leftPar != rightPar)) {
@@ -55,10 +57,10 @@ string Diff(string term, char var) {
         // find (type): logarithm function
         else if (term[i] == 'l' && i + 2 < term.length) {
             string l;
-            if (term.slice(i, i + 3) == "log") {
+            if (term.sliceView(i, i + 3) == "log") {
                 l = "log";
             }
-            else if (term.slice(i, i + 2) == "ln") {
+            else if (term.sliceView(i, i + 2) == "ln") {
                 l = "ln";
             }
         }
@@ -162,4 +164,140 @@ string Diff(string term, char var) {
     return result;
 }
 
+/* memo of a differentiation pass: index of each source node in the result, and of its derivative.
+   Every source node is copied and differentiated at most once, so the work is linear in the DAG size. */
+struct diffContext {
+    Expression *src;
+    Expression *dst;
+    array<int> copied;
+    array<int> derived;
+    array<bool> varying; // source node depends on x
+};
+
+/* The method copies a source node into the result once, so shared subterms stay shared. */
+int copyNode(diffContext &ctx, int index) {
+    if (ctx.copied[index] >= 0)
+        return ctx.copied[index];
+
+    exprNode node = ctx.src->nodes[index];
+    if (node.left >= 0)
+        node.left = copyNode(ctx, node.left);
+    if (node.right >= 0)
+        node.right = copyNode(ctx, node.right);
+
+    ctx.copied[index] = addNode(*ctx.dst, node.type, node.value, node.left, node.right);
+    return ctx.copied[index];
+}
+
+int diffNode(diffContext &ctx, int index) {
+    if (ctx.derived[index] >= 0)
+        return ctx.derived[index];
+
+    Expression &d = *ctx.dst;
+    exprNode node = ctx.src->nodes[index];
+    int result = 0;
+
+    switch (node.type) {
+        case EXPR_CONST:
+        case EXPR_Y: // partial derivative: y is held constant
+            result = makeConst(d, 0);
+            break;
+        case EXPR_X:
+            result = makeConst(d, 1);
+            break;
+        case EXPR_ADD:
+        case EXPR_SUB:
+            result = makeBinary(d, node.type, diffNode(ctx, node.left), diffNode(ctx, node.right));
+            break;
+        case EXPR_MUL: { // u'v + uv'
+            int du = diffNode(ctx, node.left), dv = diffNode(ctx, node.right);
+            int u = copyNode(ctx, node.left), v = copyNode(ctx, node.right);
+
+            result = makeBinary(d, EXPR_ADD, makeBinary(d, EXPR_MUL, du, v), makeBinary(d, EXPR_MUL, u, dv));
+        } break;
+        case EXPR_DIV: { // (u'v - uv')/v^2
+            int du = diffNode(ctx, node.left), dv = diffNode(ctx, node.right);
+            int u = copyNode(ctx, node.left), v = copyNode(ctx, node.right);
+            int top = makeBinary(d, EXPR_SUB, makeBinary(d, EXPR_MUL, du, v), makeBinary(d, EXPR_MUL, u, dv));
+
+            result = makeBinary(d, EXPR_DIV, top, makeBinary(d, EXPR_POW, v, makeConst(d, 2)));
+        } break;
+        case EXPR_POW: {
+            int u = copyNode(ctx, node.left), v = copyNode(ctx, node.right);
+            int du = diffNode(ctx, node.left);
+
+            if (!ctx.varying[node.right]) { // CASE: u^n = n*u^(n-1)*u'
+                int n1 = makeBinary(d, EXPR_SUB, v, makeConst(d, 1));
+                result = makeBinary(d, EXPR_MUL, makeBinary(d, EXPR_MUL, v, makeBinary(d, EXPR_POW, u, n1)), du);
+            }
+            else { // CASE: u^v = u^v*(v'ln(u) + v*u'/u)
+                int dv = diffNode(ctx, node.right);
+                int uv = copyNode(ctx, index);
+                int inner = makeBinary(d, EXPR_ADD, makeBinary(d, EXPR_MUL, dv, makeUnary(d, EXPR_LN, u)),
+                                       makeBinary(d, EXPR_DIV, makeBinary(d, EXPR_MUL, v, du), u));
+                result = makeBinary(d, EXPR_MUL, uv, inner);
+            }
+        } break;
+        case EXPR_NEG:
+            result = makeUnary(d, EXPR_NEG, diffNode(ctx, node.left));
+            break;
+        default: { // CASE: f(u) = f'(u)*u'
+            int u = copyNode(ctx, node.left);
+            int du = diffNode(ctx, node.left);
+            int outer = 0;
+
+            switch (node.type) {
+                case EXPR_SIN:
+                    outer = makeUnary(d, EXPR_COS, u);
+                    break;
+                case EXPR_COS:
+                    outer = makeUnary(d, EXPR_NEG, makeUnary(d, EXPR_SIN, u));
+                    break;
+                case EXPR_TAN:
+                    outer = makeBinary(d, EXPR_POW, makeUnary(d, EXPR_SEC, u), makeConst(d, 2));
+                    break;
+                case EXPR_COT:
+                    outer = makeUnary(d, EXPR_NEG, makeBinary(d, EXPR_POW, makeUnary(d, EXPR_CSC, u), makeConst(d, 2)));
+                    break;
+                case EXPR_SEC:
+                    outer = makeBinary(d, EXPR_MUL, makeUnary(d, EXPR_SEC, u), makeUnary(d, EXPR_TAN, u));
+                    break;
+                case EXPR_CSC:
+                    outer = makeUnary(d, EXPR_NEG, makeBinary(d, EXPR_MUL, makeUnary(d, EXPR_CSC, u), makeUnary(d, EXPR_COT, u)));
+                    break;
+                case EXPR_LN:
+                    outer = makeBinary(d, EXPR_DIV, makeConst(d, 1), u);
+                    break;
+                default: // EXPR_LOG: 1/(u*ln(b))
+                    outer = makeBinary(d, EXPR_DIV, makeConst(d, 1), makeBinary(d, EXPR_MUL, u, makeConst(d, log(node.value))));
+            }
+
+            if (outer >= 0 && d.nodes[outer].type == EXPR_NEG) // -f'(u)*u' instead of (-f'(u))*u'
+                result = makeUnary(d, EXPR_NEG, makeBinary(d, EXPR_MUL, d.nodes[outer].left, du));
+            else
+                result = makeBinary(d, EXPR_MUL, outer, du);
+        }
+    }
+
+    ctx.derived[index] = result;
+    return result;
+}
+
+/* The method differentiates a compiled expression with respect to x, and returns the derivative as a new expression. */
+Expression diffExpr(Expression &expr) {
+    Expression result;
+    diffContext ctx = {&expr, &result, array<int>(), array<int>(), array<bool>()};
+
+    for (unsigned i = 0; i < expr.nodes.length; i++) { // children come first, so one pass fills varying
+        exprNode &node = expr.nodes[i];
+
+        ctx.copied.push(-1);
+        ctx.derived.push(-1);
+        ctx.varying.push(node.type == EXPR_X || (node.left >= 0 && ctx.varying[node.left]) || (node.right >= 0 && ctx.varying[node.right]));
+    }
+
+    result.root = diffNode(ctx, expr.root);
+    return result;
+}
+
 #endif
@@ -0,0 +1,279 @@
+#ifndef DIFFCACHE_H
+#define DIFFCACHE_H
+
+#include <mutex>
+#include <utility>
+
+/* Memo of derivatives across calls: (canonical expression, variable, order) -> derivative.
+   The canonical form is the DAG's reachable nodes renumbered in post order (see compactNode), so
+   "sin(3x)" typed twice, or written with other spacing, is the same key. Within one diffExpr pass the
+   derived[] memo already makes repeated inner chain-rule calls lookups; this cache is for repeats between
+   passes. All access is under the cache's mutex, so one cache can be shared by threads. */
+
+/* number of derivatives kept by diffCache unless configured otherwise */
+const unsigned DIFF_CACHE_CAPACITY = 256;
+
+enum cachePolicy
+{
+    CACHE_LRU, // a hit moves the entry to the front, the least recently used is evicted
+    CACHE_FIFO // hits do not reorder, the oldest entry is evicted
+};
+
+struct cacheStats
+{
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    unsigned size;
+    unsigned capacity;
+};
+
+struct cacheEntry
+{
+    array<exprNode> key; // canonical nodes of the differentiated expression
+    unsigned hash;
+    char var;
+    unsigned order;
+    Expression value;
+    int prev;  // recency list, front = most recent (LRU) or newest (FIFO)
+    int next;
+    int chain; // next entry in the same bucket
+};
+
+struct derivCache
+{
+    std::mutex lock;
+    array<cacheEntry> entries;
+    array<int> buckets; // first entry of each hash chain, -1 = empty
+    int front;
+    int back;
+    unsigned capacity;
+    cachePolicy policy;
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+
+    derivCache(unsigned capacity = DIFF_CACHE_CAPACITY, cachePolicy policy = CACHE_LRU);
+};
+
+/* shared by diffExpr(expr, order) and Diff(expr, var) */
+derivCache diffCache;
+
+/* The method empties the cache and sets its capacity (0 disables it) and eviction policy. */
+/* Note: must not be called while another thread is using the cache. */
+void configureCache(derivCache &cache, unsigned capacity, cachePolicy policy)
+{
+    unsigned bucketCount = 16;
+    while (bucketCount < 2 * capacity)
+        bucketCount *= 2;
+
+    cache.entries = array<cacheEntry>();
+    cache.entries.reserve(capacity);
+    cache.buckets = array<int>();
+    cache.buckets.reserve(bucketCount);
+    for (unsigned i = 0; i < bucketCount; i++)
+        cache.buckets.push(-1);
+
+    cache.front = cache.back = -1;
+    cache.capacity = capacity;
+    cache.policy = policy;
+    cache.hits = cache.misses = cache.evictions = 0;
+}
+
+derivCache::derivCache(unsigned capacity, cachePolicy policy)
+{
+    configureCache(*this, capacity, policy);
+}
+
+cacheStats getCacheStats(derivCache &cache)
+{
+    std::lock_guard<std::mutex> guard(cache.lock);
+    cacheStats stats = {cache.hits, cache.misses, cache.evictions, cache.entries.length, cache.capacity};
+
+    return stats;
+}
+
+/* The method builds the canonical key of an expression: its reachable nodes renumbered in post order. */
+unsigned canonicalKey(Expression &expr, array<exprNode> &key)
+{
+    Expression compact;
+    array<int> copied;
+
+    copied.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+        copied.push(-1);
+
+    compactNode(expr, expr.root, compact, copied);
+
+    unsigned hash = compact.nodes.length;
+    for (unsigned i = 0; i < compact.nodes.length; i++)
+        hash = hash * 31 + hashNode(compact.nodes[i]);
+
+    key = std::move(compact.nodes);
+    return hash;
+}
+
+bool sameKey(cacheEntry &entry, array<exprNode> &key, unsigned hash, char var, unsigned order)
+{
+    if (entry.hash != hash || entry.var != var || entry.order != order || entry.key.length != key.length)
+        return false;
+
+    for (unsigned i = 0; i < key.length; i++)
+    {
+        if (!sameNode(entry.key[i], key[i]))
+            return false;
+    }
+
+    return true;
+}
+
+void unlinkEntry(derivCache &cache, int index)
+{
+    cacheEntry &entry = cache.entries[index];
+
+    if (entry.prev >= 0)
+        cache.entries[entry.prev].next = entry.next;
+    else
+        cache.front = entry.next;
+
+    if (entry.next >= 0)
+        cache.entries[entry.next].prev = entry.prev;
+    else
+        cache.back = entry.prev;
+}
+
+void linkFront(derivCache &cache, int index)
+{
+    cacheEntry &entry = cache.entries[index];
+
+    entry.prev = -1;
+    entry.next = cache.front;
+    if (cache.front >= 0)
+        cache.entries[cache.front].prev = index;
+    cache.front = index;
+
+    if (cache.back < 0)
+        cache.back = index;
+}
+
+/* The method finds an entry; caller holds the lock. */
+int findEntry(derivCache &cache, array<exprNode> &key, unsigned hash, char var, unsigned order)
+{
+    int i = cache.buckets[(hash ^ order ^ var) & (cache.buckets.length - 1)];
+
+    while (i >= 0 && !sameKey(cache.entries[i], key, hash, var, order))
+        i = cache.entries[i].chain;
+
+    return i;
+}
+
+/* The method looks a derivative up, and counts the hit or miss unless counted is false. */
+bool cacheLookup(derivCache &cache, array<exprNode> &key, unsigned hash, char var, unsigned order, Expression &result, bool counted = true)
+{
+    std::lock_guard<std::mutex> guard(cache.lock);
+
+    int i = cache.capacity == 0 ? -1 : findEntry(cache, key, hash, var, order);
+    if (i < 0)
+    {
+        if (counted)
+            cache.misses++;
+        return false;
+    }
+
+    if (cache.policy == CACHE_LRU)
+    {
+        unlinkEntry(cache, i);
+        linkFront(cache, i);
+    }
+
+    if (counted)
+        cache.hits++;
+    result = cache.entries[i].value;
+
+    return true;
+}
+
+/* The method stores a derivative, evicting the entry at the back of the list when the cache is full. */
+void cacheStore(derivCache &cache, array<exprNode> &key, unsigned hash, char var, unsigned order, Expression &value)
+{
+    std::lock_guard<std::mutex> guard(cache.lock);
+
+    if (cache.capacity == 0 || findEntry(cache, key, hash, var, order) >= 0)
+        return; // another thread got there first
+
+    int i;
+    if (cache.entries.length < cache.capacity)
+    {
+        cacheEntry entry = {}; // zeroed, so nothing undefined is moved into entries
+        cache.entries.push(std::move(entry));
+        i = cache.entries.length - 1;
+    }
+    else
+    {
+        i = cache.back;
+        unlinkEntry(cache, i);
+
+        cacheEntry &old = cache.entries[i];
+        int *link = &cache.buckets[(old.hash ^ old.order ^ old.var) & (cache.buckets.length - 1)];
+        while (*link != i)
+            link = &cache.entries[*link].chain;
+        *link = old.chain;
+
+        cache.evictions++;
+    }
+
+    cacheEntry &entry = cache.entries[i];
+    int &bucket = cache.buckets[(hash ^ order ^ var) & (cache.buckets.length - 1)];
+
+    entry.key = key;
+    entry.hash = hash;
+    entry.var = var;
+    entry.order = order;
+    entry.value = value;
+    entry.chain = bucket;
+    bucket = i;
+
+    linkFront(cache, i);
+}
+
+/* The method returns the order-th derivative of expr, from the cache when an earlier call computed it.
+   On a miss it starts from the highest lower order in the cache, and stores every order it computes. */
+Expression diffExpr(Expression &expr, unsigned order, derivCache &cache = diffCache)
+{
+    if (order == 0)
+        return expr;
+
+    array<exprNode> key;
+    unsigned hash = canonicalKey(expr, key);
+    Expression result;
+
+    if (cacheLookup(cache, key, hash, 'x', order, result))
+        return result;
+
+    unsigned start = order - 1;
+    while (start > 0 && !cacheLookup(cache, key, hash, 'x', start, result, false))
+        start--;
+    if (start == 0)
+        result = expr;
+
+    for (unsigned n = start + 1; n <= order; n++)
+    {
+        result = diffExpr(result);
+        cacheStore(cache, key, hash, 'x', n, result);
+    }
+
+    return result;
+}
+
+/* The method differentiates a compiled expression without re-reading its text. Compiled expressions are
+   differentiated in x only; any other var throws rather than answering 0. */
+string Diff(Expression &expr, char var)
+{
+    if (var != 'x')
+        throw "Bad arithmetic expression: compiled expressions are differentiated in x only.";
+
+    Expression derivative = diffExpr(expr, 1);
+    return exprToStr(derivative);
+}
+
+#endif
@@ -0,0 +1,650 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+/* node types of a compiled expression */
+enum exprType
+{
+    EXPR_CONST,
+    EXPR_X,
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_POW,
+    EXPR_NEG,
+    EXPR_SIN,
+    EXPR_COS,
+    EXPR_TAN,
+    EXPR_COT,
+    EXPR_SEC,
+    EXPR_CSC,
+    EXPR_LN,
+    EXPR_LOG,
+    EXPR_Y // y of an implicit function F(x, y) = 0, only parsed by compileExpr(text, true)
+};
+
+struct exprNode
+{
+    exprType type;
+    double value; // constant value, or base of log
+    int left;     // operand of unary node, left operand of binary node
+    int right;
+};
+
+/* Children are always stored before their parent, so nodes[root] is the last one evaluated.
+   Nodes are hash-consed: a node equal to an existing one is never added twice, so identical
+   subexpressions are one shared node and the expression is a DAG rather than a tree.
+   Note: nodes must not be changed in place once added, or table goes stale. */
+struct Expression
+{
+    array<exprNode> nodes;
+    int root;
+    array<int> table; // open-addressing index of nodes: node index + 1, 0 = empty
+};
+
+unsigned hashNode(const exprNode &node)
+{
+    uint64_t bits;
+    memcpy(&bits, &node.value, sizeof(bits));
+
+    uint64_t h = bits ^ ((uint64_t)node.type << 56) ^ ((uint64_t)(unsigned)node.left << 28) ^ (unsigned)node.right;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+
+    return (unsigned)h;
+}
+
+bool sameNode(const exprNode &a, const exprNode &b)
+{
+    return a.type == b.type && a.left == b.left && a.right == b.right && memcmp(&a.value, &b.value, sizeof(double)) == 0;
+}
+
+/* The method rebuilds the hash-consing index at twice the needed size. */
+void rehashExpr(Expression &expr)
+{
+    unsigned capacity = 16;
+    while (capacity < 4 * (expr.nodes.length + 1))
+        capacity *= 2;
+
+    expr.table = array<int>();
+    expr.table.reserve(capacity);
+    for (unsigned i = 0; i < capacity; i++)
+        expr.table.push(0);
+
+    for (unsigned n = 0; n < expr.nodes.length; n++)
+    {
+        unsigned i = hashNode(expr.nodes[n]) & (capacity - 1);
+        while (expr.table[i] != 0)
+            i = (i + 1) & (capacity - 1);
+
+        expr.table[i] = n + 1;
+    }
+}
+
+/* The method returns the index of the node (type, value, left, right), adding it only if it is new. */
+int addNode(Expression &expr, exprType type, double value, int left, int right)
+{
+    exprNode node = {type, value, left, right};
+
+    if (expr.table.length < 2 * (expr.nodes.length + 1))
+        rehashExpr(expr);
+
+    unsigned mask = expr.table.length - 1;
+    for (unsigned i = hashNode(node) & mask;; i = (i + 1) & mask)
+    {
+        int slot = expr.table[i];
+
+        if (slot == 0)
+        {
+            expr.nodes.push(node);
+            expr.table[i] = expr.nodes.length;
+
+            return expr.nodes.length - 1;
+        }
+        if (sameNode(expr.nodes[slot - 1], node))
+            return slot - 1;
+    }
+}
+
+/* The method counts the distinct nodes reachable from index. */
+unsigned countNodes(Expression &expr, int index, array<bool> &seen)
+{
+    if (seen[index])
+        return 0;
+
+    seen[index] = true;
+    exprNode &node = expr.nodes[index];
+    unsigned count = 1;
+
+    if (node.left >= 0)
+        count += countNodes(expr, node.left, seen);
+    if (node.right >= 0)
+        count += countNodes(expr, node.right, seen);
+
+    return count;
+}
+
+/* The method returns the size of the DAG: the number of distinct nodes reachable from the root. */
+unsigned exprSize(Expression &expr)
+{
+    array<bool> seen;
+    seen.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+        seen.push(false);
+
+    return countNodes(expr, expr.root, seen);
+}
+
+int makeConst(Expression &expr, double value)
+{
+    return addNode(expr, EXPR_CONST, value, -1, -1);
+}
+
+bool isConstNode(Expression &expr, int index, double value)
+{
+    return expr.nodes[index].type == EXPR_CONST && expr.nodes[index].value == value;
+}
+
+/* The method builds op(l, r), dropping the trivial identities (0+u, 1*u, u^1, ...) on the way. */
+int makeBinary(Expression &expr, exprType type, int l, int r)
+{
+    exprNode left = expr.nodes[l], right = expr.nodes[r];
+
+    if (left.type == EXPR_CONST && right.type == EXPR_CONST && type != EXPR_POW)
+    {
+        if (type == EXPR_ADD)
+            return makeConst(expr, left.value + right.value);
+        if (type == EXPR_SUB)
+            return makeConst(expr, left.value - right.value);
+        if (type == EXPR_MUL)
+            return makeConst(expr, left.value * right.value);
+        if (type == EXPR_DIV && right.value != 0)
+            return makeConst(expr, left.value / right.value);
+    }
+
+    switch (type)
+    {
+    case EXPR_ADD:
+        if (isConstNode(expr, l, 0))
+            return r;
+        if (isConstNode(expr, r, 0))
+            return l;
+        break;
+    case EXPR_SUB:
+        if (isConstNode(expr, r, 0))
+            return l;
+        if (isConstNode(expr, l, 0))
+            return addNode(expr, EXPR_NEG, 0, r, -1);
+        break;
+    case EXPR_MUL:
+        if (isConstNode(expr, l, 0) || isConstNode(expr, r, 0))
+            return makeConst(expr, 0);
+        if (isConstNode(expr, l, 1))
+            return r;
+        if (isConstNode(expr, r, 1))
+            return l;
+        break;
+    case EXPR_DIV:
+        if (isConstNode(expr, r, 1))
+            return l;
+        if (isConstNode(expr, l, 0))
+            return makeConst(expr, 0);
+        break;
+    case EXPR_POW:
+        if (isConstNode(expr, r, 1))
+            return l;
+        if (isConstNode(expr, r, 0))
+            return makeConst(expr, 1);
+        break;
+    default:
+        break;
+    }
+
+    return addNode(expr, type, 0, l, r);
+}
+
+int makeUnary(Expression &expr, exprType type, int operand)
+{
+    if (type == EXPR_NEG && expr.nodes[operand].type == EXPR_CONST)
+        return makeConst(expr, -expr.nodes[operand].value);
+    if (type == EXPR_NEG && expr.nodes[operand].type == EXPR_NEG)
+        return expr.nodes[operand].left;
+
+    return addNode(expr, type, 0, operand, -1);
+}
+
+bool isDigitChar(char c)
+{
+    return (c >= '0' && c <= '9') || c == '.';
+}
+
+/* recursive descent parser: sum -> product -> unary -> power -> primary */
+struct exprParser
+{
+    string_view text; // the parser never copies the input
+    unsigned pos;
+    Expression *out;
+    bool implicit; // accept y
+
+    char peek()
+    {
+        while (pos < text.length && text[pos] == ' ')
+            pos++;
+
+        return pos < text.length ? text[pos] : '\0';
+    }
+
+    bool matchWord(const char *word)
+    {
+        string_view name(word);
+
+        if (!text.startsWith(name, pos))
+            return false;
+
+        pos += name.length;
+        return true;
+    }
+
+    double parseNumber()
+    {
+        unsigned start = pos;
+
+        while (pos < text.length && isDigitChar(text[pos]))
+            pos++;
+
+        if (pos + 1 < text.length && (text[pos] == 'e' || text[pos] == 'E')) // 1e-07, as written by writeNum
+        {
+            unsigned digit = pos + 1 + (text[pos + 1] == '-' || text[pos + 1] == '+');
+
+            if (digit < text.length && text[digit] >= '0' && text[digit] <= '9')
+            {
+                pos = digit;
+                while (pos < text.length && text[pos] >= '0' && text[pos] <= '9')
+                    pos++;
+            }
+        }
+
+        return parseNum(text.slice(start, pos));
+    }
+
+    int parseSum()
+    {
+        int result = parseProduct();
+
+        while (peek() == '+' || peek() == '-')
+        {
+            exprType type = text[pos++] == '+' ? EXPR_ADD : EXPR_SUB;
+            result = addNode(*out, type, 0, result, parseProduct());
+        }
+
+        return result;
+    }
+
+    int parseProduct()
+    {
+        int result = parseUnary();
+
+        while (true)
+        {
+            char c = peek();
+
+            if (c == '*' || c == '/')
+            {
+                pos++;
+                result = addNode(*out, c == '*' ? EXPR_MUL : EXPR_DIV, 0, result, parseUnary());
+            }
+            else if (isDigitChar(c) || c == 'x' || c == '(' || c == 's' || c == 'c' || c == 't' || c == 'l' || (implicit && c == 'y')) // 3x^2sin(3x)
+                result = addNode(*out, EXPR_MUL, 0, result, parsePower());
+            else
+                break;
+        }
+
+        return result;
+    }
+
+    int parseUnary()
+    {
+        if (peek() == '-')
+        {
+            pos++;
+            return makeUnary(*out, EXPR_NEG, parseUnary()); // -3 is a constant
+        }
+        if (peek() == '+')
+        {
+            pos++;
+            return parseUnary();
+        }
+
+        return parsePower();
+    }
+
+    int parsePower()
+    {
+        int base = parsePrimary();
+
+        if (peek() == '^')
+        {
+            pos++;
+            return addNode(*out, EXPR_POW, 0, base, parseUnary()); // x^-2, x^2^3 = x^(2^3)
+        }
+
+        return base;
+    }
+
+    int parsePrimary()
+    {
+        char c = peek();
+
+        if (isDigitChar(c))
+            return makeConst(*out, parseNumber());
+
+        if (c == 'x')
+        {
+            pos++;
+            return addNode(*out, EXPR_X, 0, -1, -1);
+        }
+        if (c == 'y' && implicit)
+        {
+            pos++;
+            return addNode(*out, EXPR_Y, 0, -1, -1);
+        }
+
+        if (c == '(')
+        {
+            pos++;
+            int inner = parseSum();
+
+            if (peek() != ')')
+                throw "Bad arithmetic expression: no complete pair of parentheses ['()'].";
+            pos++;
+
+            return inner;
+        }
+
+        if (matchWord("sin"))
+            return parseFunction(EXPR_SIN, 0);
+        if (matchWord("cos"))
+            return parseFunction(EXPR_COS, 0);
+        if (matchWord("tan"))
+            return parseFunction(EXPR_TAN, 0);
+        if (matchWord("cot"))
+            return parseFunction(EXPR_COT, 0);
+        if (matchWord("sec"))
+            return parseFunction(EXPR_SEC, 0);
+        if (matchWord("csc"))
+            return parseFunction(EXPR_CSC, 0);
+        if (matchWord("ln"))
+            return parseFunction(EXPR_LN, 0);
+        if (matchWord("log")) // log10(u), log(u) = log10(u)
+            return parseFunction(EXPR_LOG, isDigitChar(peek()) ? parseNumber() : 10);
+
+        if (c == '\0')
+            throw "Bad arithmetic expression: missing operand.";
+        throw "Bad arithmetic expression: unknown symbol.";
+    }
+
+    int parseFunction(exprType type, double base)
+    {
+        double power = 1;
+
+        if (peek() == '^') // sin^n(u)
+        {
+            pos++;
+            power = parseNumber();
+        }
+
+        int argument = peek() == '(' ? parsePrimary() : parsePower();
+        int result = addNode(*out, type, base, argument, -1);
+
+        if (power != 1)
+            result = addNode(*out, EXPR_POW, 0, result, makeConst(*out, power));
+
+        return result;
+    }
+};
+
+/* The method parses an expression once into a tree that can be evaluated many times.
+   With implicit set, y is a second variable: the text is F(x, y) of F(x, y) = 0. */
+Expression compileExpr(string text, bool implicit = false)
+{
+    Expression expr;
+    exprParser parser = {text.view(), 0, &expr, implicit};
+
+    expr.root = parser.parseSum();
+
+    if (parser.peek() != '\0')
+        throw "Bad arithmetic expression: unexpected character.";
+
+    return expr;
+}
+
+/* marks and values of evalNode, grown as needed, one per thread, so a call allocates only on a larger DAG
+   than this thread has evaluated before */
+thread_local array<bool> evalReached;
+thread_local array<double> evalValues;
+
+/* The method evaluates a node of the DAG; trigonometric functions take radians. Children come before their
+   parents, so the nodes below index are marked walking down from it and then evaluated once each walking up,
+   however often they are shared. */
+double evalNode(Expression &expr, int index, double x)
+{
+    if (evalValues.length < (unsigned)index + 1)
+    {
+        evalReached.reserve(index + 1);
+        evalValues.reserve(index + 1);
+        while (evalValues.length < (unsigned)index + 1)
+        {
+            evalReached.push(false);
+            evalValues.push(0);
+        }
+    }
+
+    bool *reached = &evalReached[0];
+    double *values = &evalValues[0];
+
+    for (int i = 0; i < index; i++)
+        reached[i] = false;
+    reached[index] = true;
+
+    for (int i = index; i >= 0; i--)
+    {
+        exprNode &node = expr.nodes[i];
+
+        if (!reached[i])
+            continue;
+        if (node.type == EXPR_Y)
+            throw "Bad arithmetic expression: y is only defined for implicit functions.";
+        if (node.left >= 0)
+            reached[node.left] = true;
+        if (node.right >= 0)
+            reached[node.right] = true;
+    }
+
+    for (int i = 0; i <= index; i++)
+    {
+        exprNode &node = expr.nodes[i];
+        double a = node.left >= 0 ? values[node.left] : 0, b = node.right >= 0 ? values[node.right] : 0;
+
+        if (!reached[i])
+            continue;
+
+        switch (node.type)
+        {
+        case EXPR_CONST:
+            values[i] = node.value;
+            break;
+        case EXPR_X:
+            values[i] = x;
+            break;
+        case EXPR_ADD:
+            values[i] = a + b;
+            break;
+        case EXPR_SUB:
+            values[i] = a - b;
+            break;
+        case EXPR_MUL:
+            values[i] = a * b;
+            break;
+        case EXPR_DIV:
+            values[i] = a / b;
+            break;
+        case EXPR_POW:
+            values[i] = pow(a, b);
+            break;
+        case EXPR_NEG:
+            values[i] = -a;
+            break;
+        case EXPR_SIN:
+            values[i] = sin(a);
+            break;
+        case EXPR_COS:
+            values[i] = cos(a);
+            break;
+        case EXPR_TAN:
+            values[i] = tan(a);
+            break;
+        case EXPR_COT:
+            values[i] = 1 / tan(a);
+            break;
+        case EXPR_SEC:
+            values[i] = 1 / cos(a);
+            break;
+        case EXPR_CSC:
+            values[i] = 1 / sin(a);
+            break;
+        case EXPR_LN:
+            values[i] = log(a);
+            break;
+        case EXPR_LOG:
+            values[i] = log(a) / log(node.value);
+            break;
+        case EXPR_Y: // refused above
+            break;
+        }
+    }
+
+    return values[index];
+}
+
+/* precedence used to decide where the printer needs parentheses */
+int exprPrecedence(Expression &expr, int index)
+{
+    exprNode &node = expr.nodes[index];
+
+    switch (node.type)
+    {
+    case EXPR_ADD:
+    case EXPR_SUB:
+        return 1;
+    case EXPR_MUL:
+    case EXPR_DIV:
+        return 2;
+    case EXPR_NEG:
+        return 3;
+    case EXPR_POW:
+        return 4;
+    case EXPR_CONST:
+        return node.value < 0 ? 3 : 5;
+    default:
+        return 5;
+    }
+}
+
+string exprToStr(Expression &expr, int index);
+
+string wrapExpr(Expression &expr, int index, bool parenthesize)
+{
+    string inner = exprToStr(expr, index);
+
+    if (!parenthesize)
+        return inner;
+
+    string result = "(";
+    result += inner;
+    result += ")";
+
+    return result;
+}
+
+/* The method prints a node of the tree back into an expression string. */
+string exprToStr(Expression &expr, int index)
+{
+    exprNode &node = expr.nodes[index];
+    int prec = exprPrecedence(expr, index);
+    string result = "";
+
+    switch (node.type)
+    {
+    case EXPR_CONST:
+        writeNum(result, node.value);
+        break;
+    case EXPR_X:
+        return "x";
+    case EXPR_Y:
+        return "y";
+    case EXPR_ADD:
+    case EXPR_SUB:
+    {
+        bool subtract = node.type == EXPR_SUB;
+        int right = node.right;
+
+        if (expr.nodes[right].type == EXPR_NEG) // a+-b = a-b
+        {
+            subtract = !subtract;
+            right = expr.nodes[right].left;
+        }
+
+        result += wrapExpr(expr, node.left, exprPrecedence(expr, node.left) < prec);
+        if (expr.nodes[right].type == EXPR_CONST && expr.nodes[right].value < 0) // a+-3 = a-3
+        {
+            result += subtract ? "+" : "-";
+            writeNum(result, -expr.nodes[right].value);
+            break;
+        }
+        result += subtract ? "-" : "+";
+        result += wrapExpr(expr, right, exprPrecedence(expr, right) < prec || (subtract && exprPrecedence(expr, right) == prec));
+    }
+    break;
+    case EXPR_MUL:
+    case EXPR_DIV:
+    {
+        string right = wrapExpr(expr, node.right, exprPrecedence(expr, node.right) < prec || (node.type == EXPR_DIV && exprPrecedence(expr, node.right) == prec));
+        bool implicit = node.type == EXPR_MUL && expr.nodes[node.left].type == EXPR_CONST && node.left != node.right &&
+                        expr.nodes[node.left].value >= 0 && ((right[0] >= 'a' && right[0] <= 'z') || right[0] == '(');
+
+        result += wrapExpr(expr, node.left, exprPrecedence(expr, node.left) < prec);
+        if (!implicit) // 3x, 3sin(x), 3(x+1)
+            result += node.type == EXPR_MUL ? "*" : "/";
+        result += right;
+    }
+    break;
+    case EXPR_POW:
+        result += wrapExpr(expr, node.left, exprPrecedence(expr, node.left) <= prec);
+        result += "^";
+        result += wrapExpr(expr, node.right, exprPrecedence(expr, node.right) < prec);
+        break;
+    case EXPR_NEG:
+        result += "-";
+        result += wrapExpr(expr, node.left, exprPrecedence(expr, node.left) < prec);
+        break;
+    default:
+    {
+        const char *names[] = {"sin", "cos", "tan", "cot", "sec", "csc", "ln", "log"};
+
+        result += names[node.type - EXPR_SIN];
+        if (node.type == EXPR_LOG)
+            writeNum(result, node.value);
+        result += wrapExpr(expr, node.left, true);
+    }
+    }
+
+    return result;
+}
+
+string exprToStr(Expression &expr)
+{
+    return exprToStr(expr, expr.root);
+}
+
+#endif
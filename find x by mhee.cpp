@@ -3,6 +3,9 @@
 #include<string>
 #include<windows.h>
 
+#include "parallel.h"
+#include "polyroots.h"
+
 using namespace std;
 
 double x_one(double,double);//ax+b
@@ -11,6 +14,7 @@ double xn(double,double,double); //-b-sqrt
 double SDforx3(double,double,double,double);//ax^3+bx^2+cx+d
 double SDforx4(double,double,double,double,double);//ax^4+bx^3+cx^2+dx+e
 double SDforx5(double,double,double,double,double,double);//ax^5+bx^4+cx^3+dx^2+ex+f
+double printRoots(const double*,unsigned);//all roots, real and complex, of coef[0]x^n+...+coef[n]
 
 int main(){
 	
@@ -56,11 +60,19 @@ int main(){
 	}
 	
 	else if(oneToFive==4){
+		double a4,b4,c4,d4,e4;
+		cout<<"Enter a b c d e: ";
+		cin>>a4>>b4>>c4>>d4>>e4;
 		
+		SDforx4(a4,b4,c4,d4,e4);
 	}
 	
 	else if(oneToFive==5){
+		double a5,b5,c5,d5,e5,f5;
+		cout<<"Enter a b c d e f: ";
+		cin>>a5>>b5>>c5>>d5>>e5>>f5;
 		
+		SDforx5(a5,b5,c5,d5,e5,f5);
 	}
 	
 	
@@ -100,61 +112,50 @@ double xn(double D,double E,double F){
 }
 
 double SDforx3(double A3,double B3,double C3,double D3){
+	double coef[4]={A3,B3,C3,D3};
 	
-	double sum3=1;
-	double count1=0;
-	double count2=0;
+	return printRoots(coef,3);
+}
+
+double SDforx4(double A4,double B4,double C4,double D4,double E4){
+	double coef[5]={A4,B4,C4,D4,E4};
 	
-	for(double i=0;i<1000;i+=1){
-		
-		double t31=A3;
-		double t32=A3*i;
-		double t33=t32+B3;
-		double t34=t33*i;
-		double t35=t34+C3;
-		double t36=t35*i;
-		double t37=t36+D3;
-		
-		sum3=t37;
-		
-		if(i==999){
-			break;
-		}
-		else if(sum3==0){
-			break;
-		}
-		count1+=1;
-	}
+	return printRoots(coef,4);
+}
+
+double SDforx5(double A5,double B5,double C5,double D5,double E5,double F5){
+	double coef[6]={A5,B5,C5,D5,E5,F5};
 	
-	for(double i=0;i>-1000;i-=1){
-		
-		double t31=A3;
-		double t32=A3*i;
-		double t33=t32+B3;
-		double t34=t33*i;
-		double t35=t34+C3;
-		double t36=t35*i;
-		double t37=t36+D3;
-		
-		sum3=t37;
+	return printRoots(coef,5);
+}
+
+//prints every root with its error bound, returns how many are real
+double printRoots(const double *coef,unsigned degree){
+	complexd roots[5];
+	double errors[5];
+	double real=0;
 	
-		if(i==-999){
-			break;
-		}
-		else if(sum3==0){
-			break;
-		}
-		count2-=1;	
-		}
+	unsigned found=polyRoots(coef,degree,roots,errors);
 	
-	if(count1==999){
-		cout<<"x :"<<count2*(-1)<<endl;
-	}
-	else if(count2==-999){
+	if(found==0){
 		cout<<"--------------------";
 		cout<<"    CANNOT FIND     ";
 		cout<<"--------------------";
+		return 0;
 	}
 	
+	for(unsigned i=0;i<found;i++){
+		cout<<"x = "<<roots[i].real();
+		
+		if(roots[i].imag()!=0){
+			cout<<(roots[i].imag()<0?" - ":" + ")<<fabs(roots[i].imag())<<"i";
+		}
+		else{
+			real+=1;
+		}
+		
+		cout<<"   (+/- "<<errors[i]<<")"<<endl;
+	}
+	
+	return real;
 }
-
@@ -1,97 +1,346 @@
-double round(double number);
-void CreateGraph(int *values, int size);
+#ifndef GRAPH_H
+#define GRAPH_H
 
-string axis = "- ", point = "o ", space = "  ";
+#include <charconv>
+#include <cstdio>
+#include <ostream>
 
-int main() {
+/* Plots y = f(x) over a window. The curve is sampled adaptively: every RENDER_COARSE pixels a segment is
+   split at its midpoint until the midpoint lies within half a pixel of the straight line between its ends,
+   so flat parts cost a few evaluations and sharp bends get as many as they need. Samples are never stored:
+   each one is passed on as soon as it is made, to a path (SVG) or into per-column row spans (text, PGM, PPM)
+   from which the raster is written row by row. Memory is O(width) whatever the pixel count, and all output
+   goes through one buffer, written out when full and once at the end. */
 
-  int size = 20;
-  double step = (1.0 / 5);
+/* pixels between the first samples, before any refinement */
+const unsigned RENDER_COARSE = 8;
+/* halvings of a coarse segment at most, down to 1/512 pixel */
+const unsigned RENDER_DEPTH = 12;
+/* separate vertical runs kept per pixel column, e.g. both sides of a pole */
+const unsigned RENDER_SPANS = 4;
+/* bytes collected before each write */
+const unsigned RENDER_BUFFER = 1 << 16;
 
-  int *values = new int[size + size + 1];
-  double Y;
+enum renderFormat
+{
+    RENDER_TEXT, // one "o "/"- "/"  " cell per pixel, the old table graph
+    RENDER_PGM,  // binary greyscale
+    RENDER_PPM,  // binary colour
+    RENDER_SVG   // one path, broken at discontinuities
+};
 
-  for (int i = 0; i < size + size + 1; ++i) {
-    double x = (i - size);
-    x = x * step; //Expanding
+/* what is plotted, and at how many pixels */
+struct plotWindow
+{
+    double xmin;
+    double xmax;
+    double ymin;
+    double ymax;
+    unsigned width;
+    unsigned height;
+};
 
-    Y = sqrt(4-pow(x,2)) ; // EQUATION
+/* output collected into one block and written when full */
+struct outBuffer
+{
+    std::ostream *out;
+    char data[RENDER_BUFFER];
+    unsigned length;
+};
 
-    Y = Y / step; //Expanding Size
-    values[i] = round(Y);
-  }
+void bufferFlush(outBuffer &buffer)
+{
+    buffer.out->write(buffer.data, buffer.length);
+    buffer.length = 0;
+}
 
-  CreateGraph(values, size); // cout << "TABLE GRAPH:"
-  delete[] values;
+void bufferPut(outBuffer &buffer, const char *text, unsigned length)
+{
+    while (length > 0)
+    {
+        if (buffer.length == RENDER_BUFFER)
+            bufferFlush(buffer);
+
+        unsigned n = RENDER_BUFFER - buffer.length < length ? RENDER_BUFFER - buffer.length : length;
+        memcpy(buffer.data + buffer.length, text, n);
+
+        buffer.length += n;
+        text += n;
+        length -= n;
+    }
 }
 
-void CreateGraph(int *values, int size) //Function TABLE Graph :
+void bufferChar(outBuffer &buffer, char c)
 {
+    if (buffer.length == RENDER_BUFFER)
+        bufferFlush(buffer);
 
-  for (int i = 0; i < size + size + 1; ++i)
-  {
-    cout << endl;
-  }
-  for (int i = 0; i < size; ++i)
-  {
+    buffer.data[buffer.length++] = c;
+}
+
+/* The method appends printf-formatted text, such as a number or a header. */
+template <class... Args>
+void bufferFormat(outBuffer &buffer, const char *format, Args... args)
+{
+    char text[128];
+    int n = snprintf(text, sizeof text, format, args...);
+
+    bufferPut(buffer, text, n < (int)sizeof text ? n : sizeof text - 1);
+}
+
+/* The method appends a number in the shortest form that reads back as the same double (see writeNum). */
+void bufferNum(outBuffer &buffer, double value)
+{
+    char digits[32];
+    std::to_chars_result written = std::to_chars(digits, digits + sizeof digits, value);
+
+    bufferPut(buffer, digits, written.ptr - digits);
+}
+
+/* state of one sampling pass: the window in pixel units and where the samples go */
+template <class Sink>
+struct sampler
+{
+    Program *prog;
+    plotWindow *window;
+    Sink *sink;
+    double xscale; // pixels per unit of x
+    double yscale;
+    unsigned samples;
+};
 
-    for (int b = 0; b < size; ++b)
+/* The method returns the pixel row of f(x), NaN outside the domain; far off-window rows are clamped. */
+template <class Sink>
+double sampleRow(sampler<Sink> &s, double x)
+{
+    double y = runProgram(*s.prog, x), row = (s.window->ymax - y) * s.yscale;
+    s.samples++;
+
+    if (row != row)
+        return row;
+
+    double limit = 4.0 * s.window->height; // keeps a pole's steep sides steep but within float range
+    return row < -limit ? -limit : row > limit ? limit : row;
+}
+
+/* The method refines the segment from pixel (c0, r0) to (c1, r1) and passes every sample after c0 to the sink. */
+template <class Sink>
+void sampleSegment(sampler<Sink> &s, double c0, double r0, double c1, double r1, unsigned depth)
+{
+    bool finite = r0 == r0 && r1 == r1;
+
+    if (depth < RENDER_DEPTH)
     {
-      if (size - i == values[b])
-        cout << point;
-      else
-        cout << space;
+        double cm = 0.5 * (c0 + c1), rm = sampleRow(s, s.window->xmin + cm / s.xscale);
+        // off the domain only the edges are searched for, so a gap costs no more than a line
+        bool split = finite ? rm != rm || fabs(rm - 0.5 * (r0 + r1)) > 0.5 : r0 == r0 || r1 == r1 || rm == rm;
+
+        if (split)
+        {
+            sampleSegment(s, c0, r0, cm, rm, depth + 1);
+            sampleSegment(s, cm, rm, c1, r1, depth + 1);
+            return;
+        }
     }
 
-    if (size - i == values[size])
-      cout << point;
-    else
-      cout << axis;
+    if (r1 != r1)
+        return;
+
+    // at the finest level, a jump of a whole window height is a discontinuity, not a line
+    (*s.sink)(c1, r1, finite && (depth < RENDER_DEPTH || fabs(r1 - r0) < s.window->height));
+}
+
+/* The method samples the curve across the window, calling sink(column, row, joined) for each sample in
+   increasing x, where joined says whether a line leads to it from the previous sample. It returns the
+   number of evaluations. */
+template <class Sink>
+unsigned sampleCurve(Program &prog, plotWindow &window, Sink sink)
+{
+    sampler<Sink> s = {&prog, &window, &sink, window.width / (window.xmax - window.xmin), window.height / (window.ymax - window.ymin), 0};
+    unsigned segments = (window.width + RENDER_COARSE - 1) / RENDER_COARSE;
+    double c0 = 0, r0 = sampleRow(s, window.xmin);
 
-    for (int b = 0; b < size; ++b)
+    if (r0 == r0)
+        sink(c0, r0, false);
+
+    for (unsigned i = 1; i <= segments; i++)
     {
-      if (size - i == values[b + size + 1])
-        cout << point;
-      else
-        cout << space;
+        double c1 = i == segments ? window.width : (double)i * RENDER_COARSE;
+        double r1 = sampleRow(s, window.xmin + c1 / s.xscale);
+
+        sampleSegment(s, c0, r0, c1, r1, 0);
+        c0 = c1;
+        r0 = r1;
     }
-    cout << endl;
-  }
 
-  for (int i = 0; i < size + size + 1; ++i)
-  {
-    if (0 == values[i])
-      cout << point;
-    else
-      cout << axis;
-  }
-  cout << endl;
+    return s.samples;
+}
+
+/* the vertical runs [lo, hi] of pixel rows the curve covers in each column */
+struct columnSpans
+{
+    array<float> lo; // RENDER_SPANS per column
+    array<float> hi;
+    array<unsigned char> count;
+    double lastColumn;
+    double lastRow;
+};
+
+/* The method adds rows [lo, hi] to a column, merging it with a run it touches, or with the nearest when full. */
+void addSpan(columnSpans &spans, int column, double lo, double hi)
+{
+    if (column < 0 || column >= (int)spans.count.length)
+        return;
+
+    float *l = &spans.lo[column * RENDER_SPANS], *h = &spans.hi[column * RENDER_SPANS];
+    unsigned char &n = spans.count[column];
+    unsigned nearest = 0;
+    double distance = INFINITY;
+
+    for (unsigned k = 0; k < n; k++)
+    {
+        double gap = lo > h[k] ? lo - h[k] : l[k] > hi ? l[k] - hi : 0;
+
+        if (gap < distance)
+        {
+            distance = gap;
+            nearest = k;
+        }
+    }
 
-  for (int i = 0; i < size; ++i)
-  {
-    for (int b = 0; b < size; ++b)
+    if (distance > 1 && n < RENDER_SPANS)
     {
-      if (0 - i - 1 == values[b])
-        cout << point;
-      else
-        cout << space;
+        l[n] = lo;
+        h[n] = hi;
+        n++;
+        return;
     }
-    if (0 - i - 1 == values[size])
-      cout << point;
+
+    l[nearest] = fmin(l[nearest], lo);
+    h[nearest] = fmax(h[nearest], hi);
+}
+
+/* The method records a sample: the line from the previous one is cut at column edges and added column by column. */
+void spanSample(columnSpans &spans, double column, double row, bool joined)
+{
+    if (!joined)
+        addSpan(spans, (int)floor(column), row, row);
     else
-      cout << axis;
+    {
+        double c0 = spans.lastColumn, r0 = spans.lastRow, slope = (row - r0) / (column - c0);
 
-    for (int b = 0; b < size; ++b)
+        for (double c = c0; c < column;)
+        {
+            double next = fmin(floor(c) + 1, column);
+            double a = r0 + (c - c0) * slope, b = r0 + (next - c0) * slope;
+
+            addSpan(spans, (int)floor(c), fmin(a, b), fmax(a, b));
+            c = next;
+        }
+    }
+
+    spans.lastColumn = column;
+    spans.lastRow = row;
+}
+
+/* The method writes the raster of a sampled curve row by row, axes under the curve. */
+void writeRaster(columnSpans &spans, plotWindow &window, renderFormat format, outBuffer &buffer)
+{
+    static const char *const axis = "- ", *const point = "o ", *const space = "  "; // cells of RENDER_TEXT
+
+    // an axis off the window, however far, goes to -1, which no pixel has
+    double row = window.ymax * window.height / (window.ymax - window.ymin);
+    double column = -window.xmin * window.width / (window.xmax - window.xmin);
+    int axisRow = row >= 0 && row < window.height ? (int)floor(row) : -1;
+    int axisColumn = column >= 0 && column < window.width ? (int)floor(column) : -1;
+
+    if (format == RENDER_PGM)
+        bufferFormat(buffer, "P5\n%u %u\n255\n", window.width, window.height);
+    if (format == RENDER_PPM)
+        bufferFormat(buffer, "P6\n%u %u\n255\n", window.width, window.height);
+
+    for (unsigned r = 0; r < window.height; r++)
     {
-      if (0 - i - 1 == values[b + size + 1])
-        cout << point;
-      else
-        cout << space;
+        for (unsigned c = 0; c < window.width; c++)
+        {
+            const float *l = &spans.lo[c * RENDER_SPANS], *h = &spans.hi[c * RENDER_SPANS];
+            bool ink = false, onAxis = (int)r == axisRow || (int)c == axisColumn;
+
+            for (unsigned k = 0; k < spans.count[c] && !ink; k++)
+                ink = l[k] < r + 1 && h[k] >= r; // the run crosses pixel row [r, r+1)
+
+            if (format == RENDER_TEXT)
+            {
+                bufferPut(buffer, ink ? point : onAxis ? axis : space, 2);
+            }
+            else if (format == RENDER_PGM)
+                bufferChar(buffer, ink ? 0 : onAxis ? 160 : 255);
+            else
+            {
+                const char *colour = ink ? "\x20\x40\xc0" : onAxis ? "\xa0\xa0\xa0" : "\xff\xff\xff";
+                bufferPut(buffer, colour, 3);
+            }
+        }
+
+        if (format == RENDER_TEXT)
+            bufferChar(buffer, '\n');
     }
-    cout << endl;
-  }
 }
 
-double round(double number) {
-  return number < 0.0 ? ceil(number - 0.5) : floor(number + 0.5);
+/* The method plots expr over the window to out in the given format, and returns the number of evaluations. */
+unsigned renderGraph(Expression &expr, plotWindow &window, renderFormat format, std::ostream &out)
+{
+    if (window.width == 0 || window.height == 0 || !(window.xmin < window.xmax) || !(window.ymin < window.ymax))
+        throw "Bad plot window: empty range.";
+
+    Program prog = compileProgram(expr);
+    outBuffer *buffer = new outBuffer; // too large for the stack
+    unsigned samples;
+
+    buffer->out = &out;
+    buffer->length = 0;
+
+    if (format == RENDER_SVG)
+    {
+        double axisRow = window.ymax * window.height / (window.ymax - window.ymin);
+        double axisColumn = -window.xmin * window.width / (window.xmax - window.xmin);
+
+        bufferFormat(*buffer, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%u\" height=\"%u\">\n", window.width, window.height);
+        bufferFormat(*buffer, "<path d=\"M0 %.2f H%u M%.2f 0 V%u\" stroke=\"#a0a0a0\"/>\n", axisRow, window.width, axisColumn, window.height);
+        bufferPut(*buffer, "<path fill=\"none\" stroke=\"#2040c0\" d=\"", 38);
+
+        samples = sampleCurve(prog, window, [&](double column, double row, bool joined) {
+            bufferFormat(*buffer, joined ? "L%.2f %.2f" : "M%.2f %.2f", column, row);
+        });
+
+        bufferPut(*buffer, "\"/>\n</svg>\n", 11);
+    }
+    else
+    {
+        columnSpans spans;
+
+        spans.lo.reserve(window.width * RENDER_SPANS);
+        spans.hi.reserve(window.width * RENDER_SPANS);
+        spans.count.reserve(window.width);
+        for (unsigned i = 0; i < window.width * RENDER_SPANS; i++)
+        {
+            spans.lo.push(0);
+            spans.hi.push(0);
+        }
+        for (unsigned i = 0; i < window.width; i++)
+            spans.count.push(0);
+
+        samples = sampleCurve(prog, window, [&](double column, double row, bool joined) {
+            spanSample(spans, column, row, joined);
+        });
+
+        writeRaster(spans, window, format, *buffer);
+    }
+
+    bufferFlush(*buffer);
+    delete buffer;
+
+    return samples;
 }
+
+#endif
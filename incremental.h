@@ -0,0 +1,193 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+/* Incremental editing of a long sum. The text is cut into its top-level terms, each one parsed,
+   differentiated and simplified on its own and kept with its text; after an edit only the terms whose
+   text is new are parsed and brought up to the current derivative order, and the whole expression is
+   reassembled from the per-term DAGs (hash-consing merges what the terms share). The first term keeps
+   its own leading sign; every later term records whether it was joined by '+' or '-'. */
+
+/* a term of the sum and everything computed from it so far */
+struct termCache
+{
+    string text; // the term as typed, trimmed, without the joining sign
+    bool negative; // joined by '-'
+    Expression source; // the term
+    Expression raw; // its order-th derivative, as diffRound keeps it
+    Expression simplified;
+    unsigned order;
+};
+
+struct editSession
+{
+    array<termCache> terms;
+    bool implicit;
+    unsigned reused; // terms of the last edit that were not parsed again
+
+    editSession();
+};
+
+editSession::editSession()
+{
+    implicit = false;
+    reused = 0;
+}
+
+/* The method splits text into its top-level terms: a '+' or '-' outside parentheses that follows an operand. */
+void splitTerms(string &text, array<string> &terms, array<bool> &negative)
+{
+    unsigned depth = 0, begin = 0;
+    char last = '\0'; // last character other than a space
+    bool minus = false; // sign joining the term that starts at begin
+
+    for (unsigned i = 0; i <= text.length; i++)
+    {
+        char c = i < text.length ? text[i] : '\0';
+
+        if (c == '(')
+            depth++;
+        else if (c == ')' && depth > 0)
+            depth--;
+
+        // not after ^ * / ( or the e of 1e-07, where the sign is unary and belongs to the term
+        bool binary = depth == 0 && (c == '+' || c == '-') && (isDigitChar(last) || last == 'x' || last == 'y' || last == ')');
+
+        if (binary || c == '\0')
+        {
+            terms.push(text.slice(begin, i).trim());
+            negative.push(minus);
+
+            minus = c == '-';
+            begin = i + 1;
+        }
+
+        if (c != ' ')
+            last = c;
+    }
+}
+
+/* The method copies expr into out and returns the index of its root there. */
+int copyTerm(Expression &expr, Expression &out)
+{
+    array<int> copied;
+
+    copied.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+        copied.push(-1);
+
+    return compactNode(expr, expr.root, out, copied);
+}
+
+/* The method sets the session to a new text, keeping the terms it already has, and returns how many it reused.
+   A term is looked for at its own position first, so an edit in place costs one comparison per term. */
+unsigned editExpr(editSession &session, string text, bool implicit = false)
+{
+    array<string> texts;
+    array<bool> negative;
+    array<termCache> terms;
+    array<bool> taken;
+
+    splitTerms(text, texts, negative);
+
+    if (implicit != session.implicit)
+        session.terms = array<termCache>(); // y means something else now
+
+    for (unsigned i = 0; i < session.terms.length; i++)
+        taken.push(false);
+
+    array<int> found; // term of the session each new term reuses, or -1
+    found.reserve(texts.length);
+    terms.reserve(texts.length);
+
+    for (unsigned i = 0; i < texts.length; i++) // parse everything first, so a bad term leaves the session as it was
+    {
+        int match = i < session.terms.length && !taken[i] && session.terms[i].text == texts[i] ? i : -1;
+
+        for (unsigned j = 0; match < 0 && j < session.terms.length; j++)
+        {
+            if (!taken[j] && session.terms[j].text == texts[i])
+                match = j;
+        }
+
+        termCache term;
+        if (match >= 0)
+            taken[match] = true;
+        else
+        {
+            term.text = texts[i];
+            term.source = compileExpr(texts[i], implicit);
+            term.raw = term.simplified = term.source;
+            term.order = 0;
+        }
+
+        found.push(match);
+        terms.push(std::move(term));
+    }
+
+    session.reused = 0;
+    for (unsigned i = 0; i < terms.length; i++)
+    {
+        if (found[i] >= 0)
+        {
+            terms[i] = std::move(session.terms[found[i]]);
+            session.reused++;
+        }
+
+        terms[i].negative = negative[i];
+    }
+
+    session.terms = std::move(terms);
+    session.implicit = implicit;
+
+    return session.reused;
+}
+
+/* The method joins the chosen expression of every term into one expression, as the parser would. */
+Expression joinTerms(editSession &session, Expression termCache::*part)
+{
+    Expression whole;
+
+    for (unsigned i = 0; i < session.terms.length; i++)
+    {
+        termCache &term = session.terms[i];
+        int root = copyTerm(term.*part, whole);
+
+        whole.root = i == 0 ? root : addNode(whole, term.negative ? EXPR_SUB : EXPR_ADD, 0, whole.root, root);
+    }
+
+    return whole;
+}
+
+/* The method returns f itself. */
+Expression sessionExpr(editSession &session)
+{
+    return joinTerms(session, &termCache::source);
+}
+
+/* The method brings every term to the order-th derivative, by diffRound rounds from where each term stands,
+   and assembles raw and simplified as diffRound would; before/after receive the raw and simplified sizes. */
+void sessionDiff(editSession &session, unsigned order, Expression &raw, Expression &simplified, unsigned &before, unsigned &after)
+{
+    for (unsigned i = 0; i < session.terms.length; i++)
+    {
+        termCache &term = session.terms[i];
+        unsigned size;
+
+        if (term.order > order) // lower than before: start over from the term
+        {
+            term.raw = term.simplified = term.source;
+            term.order = 0;
+        }
+
+        for (; term.order < order; term.order++)
+            diffRound(term.raw, term.simplified, size, size);
+    }
+
+    raw = joinTerms(session, &termCache::raw);
+    simplified = joinTerms(session, &termCache::simplified);
+    simplified = simplifyExpr(simplified, before, after); // collects like terms across the terms
+
+    before = exprSize(raw);
+}
+
+#endif
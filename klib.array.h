@@ -1,23 +1,32 @@
 #ifndef KLIB_ARRAY_H
 #define KLIB_ARRAY_H
 
+#include <new>
+#include <utility>
+
 template<class _type>
 class Array {
     friend bool isArray();
     private:
-        _type *_proto_;
+        _type *_proto_;     // raw storage for _capacity_ items, the first length are constructed
+        unsigned _capacity_;
+        void grow(const unsigned);
+        void clear();
     public:
         unsigned length;
     
         Array();
         Array(const std::initializer_list<_type>);
         Array(const Array<_type> &);
+        Array(Array<_type> &&);
         ~Array();
         
         _type& operator[] (const int);
+        const _type& operator[] (const int) const;
         
-        Array<_type> operator= (const std::initializer_list<_type>);
-        Array<_type> operator= (const Array<_type> &);
+        Array<_type>& operator= (const std::initializer_list<_type>);
+        Array<_type>& operator= (const Array<_type> &);
+        Array<_type>& operator= (Array<_type> &&);
         
         /* The method is used to join two or more arrays. */
         Array<_type> concat(const std::initializer_list<_type>);
@@ -33,7 +42,7 @@ class Array {
         /* The method searches the array for the specified item, and returns its position. */
         int indexOf(const _type, const unsigned=0);
         /* The method returns the array as a string. */
-        char* join(const char *="'");
+        char* join(const char * = "'");
         /* The method returns an Array Iterator object with the keys of an array. */
         Array<unsigned> keys();
         /* The method searches the array for the specified item, and returns its position. */
@@ -46,7 +55,7 @@ class Array {
         Array<_type> sort();
         /* The method adds/removes items to/from an array, and returns the removed item(s). */
         /* Note: This method changes the original array. */
-        void splice(const unsigned, const unsigned=0, const std::initializer_list<_type>);
+        void splice(const unsigned, const unsigned, const std::initializer_list<_type>);
         /* The method returns a string with all the array values, separated by commas. */
         char* toString();
         /* method returns the array. */
@@ -54,7 +63,15 @@ class Array {
         
         unsigned push(const std::initializer_list<_type>);
         unsigned push(const Array<_type> &);
-        unsigned push(const _type);
+        unsigned push(const _type &);
+        unsigned push(_type &&);
+        /* The method constructs a new item in place at the end of the array. */
+        template<class... _args>
+        unsigned emplace(_args &&...);
+        /* The method makes room for at least n items, so the next pushes do not reallocate. */
+        void reserve(const unsigned);
+        /* The method returns the number of items the array can hold without reallocating. */
+        unsigned capacity() const;
         _type pop();
         _type unshift(const std::initializer_list<_type>);
         _type unshift(const Array<_type> &);
@@ -67,87 +84,184 @@ class Array {
 template<class _type>
 Array<_type>::Array() {
     length = 0;
+    _capacity_ = 0;
     _proto_ = NULL;
 }
 
 template<class _type>
 Array<_type>::Array(const std::initializer_list<_type> list) {
-    length = list.size(); // list.end()-list.begin()
-    _proto_ = new _type[length];
+    length = 0;
+    _capacity_ = 0;
+    _proto_ = NULL;
     
-    for (unsigned i = 0; i < length; i++) {
-        _proto_[i] = *(list.begin()+i);
+    reserve(list.size());
+    for (const _type *item = list.begin(); item != list.end(); item++) {
+        new (_proto_ + length++) _type(*item);
     }
 }
 
 template<class _type>
 Array<_type>::Array(const Array<_type> &list) {
-    length = list.length;
-    _proto_ = new _type[length];
+    length = 0;
+    _capacity_ = 0;
+    _proto_ = NULL;
     
-    for (unsigned i = 0; i < length; i++) {
-        _proto_[i] = list._proto_[i];
+    reserve(list.length);
+    for (unsigned i = 0; i < list.length; i++) {
+        new (_proto_ + length++) _type(list._proto_[i]);
     }
 }
 
+template<class _type>
+Array<_type>::Array(Array<_type> &&list) {
+    length = list.length;
+    _capacity_ = list._capacity_;
+    _proto_ = list._proto_;
+    
+    list.length = 0;
+    list._capacity_ = 0;
+    list._proto_ = NULL;
+}
+
 template<class _type>
 Array<_type>::~Array() {
-    delete[] _proto_;
+    clear();
+    ::operator delete(_proto_);
 }
 
 /* call operators */
 template<class _type>
 _type& Array<_type>::operator[] (const int index) {return _proto_[index];}
 
+template<class _type>
+const _type& Array<_type>::operator[] (const int index) const {return _proto_[index];}
+
 /* processing operators: FRIEND */
 
 /* processing operators: OVERLOAD */
 template<class _type>
-Array<_type> Array<_type>::operator= (const std::initializer_list<_type> list) {
-    delete[] _proto_;
+Array<_type>& Array<_type>::operator= (const std::initializer_list<_type> list) {
+    clear();
 
-    length = list.size();
-    _proto_ = new _type[length];
+    reserve(list.size());
+    for (const _type *item = list.begin(); item != list.end(); item++) {
+        new (_proto_ + length++) _type(*item);
+    }
 
-    for (unsigned i = 0; i < length; i++) {
-        _proto_[i] = *(list.begin()+i);
+    return *this;
+}
+
+template<class _type>
+Array<_type>& Array<_type>::operator= (const Array<_type> &list) {
+    if (this == &list) return *this;
+
+    clear();
+
+    reserve(list.length);
+    for (unsigned i = 0; i < list.length; i++) {
+        new (_proto_ + length++) _type(list._proto_[i]);
     }
 
     return *this;
 }
 
 template<class _type>
-Array<_type> Array<_type>::operator= (const Array<_type> &list) {
-    delete[] _proto_;
+Array<_type>& Array<_type>::operator= (Array<_type> &&list) {
+    if (this == &list) return *this;
+
+    clear();
+    ::operator delete(_proto_);
 
     length = list.length;
-    _proto_ = new _type[length];
+    _capacity_ = list._capacity_;
+    _proto_ = list._proto_;
     
-    for (unsigned i = 0; i < length; i++) {
-        _proto_[i] = list._proto_[i];
-    }
+    list.length = 0;
+    list._capacity_ = 0;
+    list._proto_ = NULL;
 
     return *this;
 }
 
 /* class methods: PRIVATE */
 
+/* move the items into a buffer of at least n items (doubling, so n pushes cost O(n)) */
+template<class _type>
+void Array<_type>::grow(const unsigned n) {
+    unsigned newCapacity = _capacity_ ? _capacity_ : 4;
+    while (newCapacity < n) newCapacity *= 2;
+
+    _type *old = _proto_;
+    _proto_ = static_cast<_type *>(::operator new(sizeof(_type) * newCapacity));
+    _capacity_ = newCapacity;
+
+    for (unsigned i = 0; i < length; i++) {
+        new (_proto_ + i) _type(std::move(old[i]));
+        old[i].~_type();
+    }
+
+    ::operator delete(old);
+}
+
+/* destroy the items, keeping the buffer */
+template<class _type>
+void Array<_type>::clear() {
+    for (unsigned i = 0; i < length; i++) {
+        _proto_[i].~_type();
+    }
+
+    length = 0;
+}
+
 /* class methods: FRIEND */
 
 /* class methods: BUILT-IN */
 template<class _type>
-unsigned Array<_type>::push(const _type item) {
-    _type *old = _proto_;
-    _proto_ = new _type[++length];
+unsigned Array<_type>::push(const _type &item) {
+    if (length == _capacity_) {
+        _type copy(item); // item may live in this array
+        grow(length + 1);
+        new (_proto_ + length) _type(std::move(copy));
+    }
+    else {
+        new (_proto_ + length) _type(item);
+    }
 
-    for (unsigned i = 0; i < length-1; i++) {
-        _proto_[i] = old[i];
+    return ++length;
+}
+
+template<class _type>
+unsigned Array<_type>::push(_type &&item) {
+    if (length == _capacity_) {
+        _type moved(std::move(item));
+        grow(length + 1);
+        new (_proto_ + length) _type(std::move(moved));
+    }
+    else {
+        new (_proto_ + length) _type(std::move(item));
     }
 
-    _proto_[length-1] = item;
-    delete[] old;
+    return ++length;
+}
+
+template<class _type>
+template<class... _args>
+unsigned Array<_type>::emplace(_args &&...args) {
+    if (length == _capacity_) grow(length + 1);
+
+    new (_proto_ + length) _type(std::forward<_args>(args)...);
+
+    return ++length;
+}
 
-    return length;
+template<class _type>
+void Array<_type>::reserve(const unsigned n) {
+    if (n > _capacity_) grow(n);
+}
+
+template<class _type>
+unsigned Array<_type>::capacity() const {
+    return _capacity_;
 }
 
 template<class _type>
@@ -1,65 +1,146 @@
+#ifndef KLIB_NUMBER_H
+#define KLIB_NUMBER_H
+
+#include <charconv>
+#include <cmath>
+#include <stdint.h>
+
 class Mathf {
     friend double powInt(double, const int);
 };
 
+/* The method raises base to an integer power by squaring, in O(log n) multiplications. */
 double powInt(double base, const int n) {
-    double result = base, inverse = 1;
-    if (n == 0) {
-        return 1;
-    }
-    else if (n == 1) {
-        return base;
-    }
-    else if (n > 0) {
-        for (int i = 1; i < n; i++) {
+    unsigned long long e = n < 0 ? -(long long)n : n;
+    double result = 1;
+
+    while (e) {
+        if (e & 1)
             result *= base;
-        }
-        return result;
-    }
-    else if (n < 0) {
-        for (int i = 0; i > n; i--) {
-            inverse /= base;
-        }
-        return inverse;
+        base *= base;
+        e >>= 1;
     }
+
+    return n < 0 ? 1 / result : result;
 }
 
 class Number {
-    friend double parseNum(string);
+    friend double parseNum(const char *, const unsigned);
+    friend double parseNum(const char *);
+    friend double parseNum(const StringView &);
+    friend double parseNum(const String &);
     friend bool isNum(char);
+    friend bool isWholeNum(const char *, const unsigned);
 };
 
-double parseNum(string t) {
-    unsigned decimalPlace = 0;
-    bool passNumber = false;
-    short isMinus = 1;
-    string parseText = "";
-    for (unsigned i = 0; i < t.length; i++) {
-        if (t[i] >= 46 && t[i] <= 57 && t[i] != '.') {
-            passNumber = true;
-            parseText += t[i];
+/* powers of ten that are exact in a double */
+const double exactPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                             1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+bool isDecimalDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+/* The method parses the first number in t (e.g. "-3.5" in "-3.5x^2", "1.2e-3"), 0 if there is none.
+   The result is the correctly rounded double, and nothing is allocated. */
+double parseNum(const char *t, const unsigned length) {
+    unsigned i = 0;
+    while (i < length && !isDecimalDigit(t[i]) && !(t[i] == '.' && i + 1 < length && isDecimalDigit(t[i + 1])))
+        i++;
+
+    if (i == length) return 0;
+
+    bool isMinus = i > 0 && t[i - 1] == '-';
+    unsigned start = i;
+    uint64_t mantissa = 0;
+    int significant = 0, exp10 = 0;
+    bool exact = true;
+
+    for (bool fraction = false; i < length; i++) {
+        if (t[i] == '.' && !fraction) {
+            fraction = true;
+            continue;
         }
-        else if (t[i] == '-' && t[i + 1] >= 46 && t[i + 1] <= 57)
-            isMinus = -1;
-        else if (t[i] == '.' && passNumber)
-            decimalPlace = parseText.length;
-        else if (passNumber)
+        if (!isDecimalDigit(t[i]))
             break;
+
+        if (significant < 19) { // 19 digits always fit in 64 bits
+            mantissa = mantissa * 10 + (t[i] - '0');
+            if (mantissa) significant++;
+            if (fraction) exp10--;
+        }
+        else {
+            if (t[i] != '0') exact = false;
+            if (!fraction) exp10++;
+        }
+    }
+
+    if (i + 1 < length && (t[i] == 'e' || t[i] == 'E')) { // 1.5e3, 1.5e-3
+        unsigned j = i + 1;
+        bool expMinus = t[j] == '-';
+        if (t[j] == '-' || t[j] == '+') j++;
+
+        if (j < length && isDecimalDigit(t[j])) {
+            int e = 0;
+            for (; j < length && isDecimalDigit(t[j]); j++) {
+                if (e < 100000) e = e * 10 + (t[j] - '0');
+            }
+
+            exp10 += expMinus ? -e : e;
+            i = j;
+        }
+    }
+
+    double result;
+    if (exact && mantissa <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) { // one correctly rounded operation
+        result = exp10 < 0 ? mantissa / exactPow10[-exp10] : mantissa * exactPow10[exp10];
     }
-    
-    if (parseText == "") return 0;
+    else {
+        std::from_chars_result read = std::from_chars(t + start, t + i, result);
+        if (read.ec == std::errc::result_out_of_range)
+            result = exp10 + significant > 0 ? HUGE_VAL : 0;
+    }
+
+    return isMinus ? -result : result;
+}
+
+double parseNum(const StringView &t) {
+    return parseNum(t.data, t.length);
+}
 
-    double parseResult = 0;
-    for (int i = parseText.length-1; i >= 0; i--) {
-        parseResult += (parseText[i]-48) * powInt(10, parseText.length-1-i);
+double parseNum(const String &t) {
+    return parseNum(t.view());
+}
+
+double parseNum(const char *t) {
+    return parseNum(StringView(t));
+}
+
+/* The method tells whether t is one number and nothing else: an optional sign, digits with at most one
+   point, and an optional exponent. parseNum skips what it does not read; this is for input that must not. */
+bool isWholeNum(const char *t, const unsigned length) {
+    unsigned i = 0, digits = 0;
+
+    if (i < length && (t[i] == '-' || t[i] == '+')) i++;
+    for (; i < length && isDecimalDigit(t[i]); i++) digits++;
+    if (i < length && t[i] == '.')
+        for (i++; i < length && isDecimalDigit(t[i]); i++) digits++;
+    if (digits == 0) return false;
+
+    if (i < length && (t[i] == 'e' || t[i] == 'E')) {
+        unsigned exponent = 0;
+
+        i++;
+        if (i < length && (t[i] == '-' || t[i] == '+')) i++;
+        for (; i < length && isDecimalDigit(t[i]); i++) exponent++;
+        if (exponent == 0) return false;
     }
-    
-    if (!decimalPlace)
-        return parseResult * isMinus;
-    else
-        return parseResult / powInt(10, parseText.length - decimalPlace) * isMinus;
+
+    return i == length;
 }
 
 bool isNum(char t) {
     return (t >= 46 && t <= 57);
-}
\ No newline at end of file
+}
+
+#endif
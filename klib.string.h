@@ -1,22 +1,69 @@
 #ifndef KLIB_STRING_H
 #define KLIB_STRING_H
 
+#include <charconv>
 #include <cstring>
 #include <string> // for iostream
 
+class String;
+
+/* A non-owning view of characters held by a String (or any c-string); slicing and splitting it
+   never allocates. Note: the view is only valid while the text it points at is alive and unchanged. */
+typedef class StringView {
+    friend std::ostream& operator<< (std::ostream &, const StringView &);
+    public:
+        const char *data;
+        /* The length property returns the number of characters in the view. */
+        unsigned length;
+
+        StringView();
+        StringView(const char *str);
+        StringView(const char *str, const unsigned);
+
+        char operator[] (const int) const;
+        bool operator== (const char *) const;
+        bool operator== (const StringView &) const;
+        bool operator!= (const char *) const;
+        bool operator!= (const StringView &) const;
+
+        /* The method returns the position of the first occurrence of a character, or -1. */
+        int indexOf(const char, const unsigned=0) const;
+        /* The method extracts parts of the view as a new view over the same characters. */
+        StringView slice(const unsigned, unsigned=-1) const;
+        /* The method splits the view into views around a separator. */
+        Array<StringView> split(const StringView &) const;
+        /* The method determines whether the view begins with the characters of a specified string. */
+        bool startsWith(const StringView &, const unsigned=0) const;
+        /* The method copies the viewed characters into a new String. */
+        String toString() const;
+} string_view;
+
 typedef class String {
-    friend String operator+ (const char *, String &);
+    friend String operator+ (const char *, const String &);
     friend std::ostream& operator<< (std::ostream &, const String &);
     friend std::istream& operator>> (std::istream &, String &);
     friend std::istream& getline(std::istream &, String &);
+    /* The method writes a number in the shortest form that reads back to the same double. */
+    friend void writeNum(String &, const double);
     /* The method converts numbers to arithmetic string. */
     template <class number>
     friend String toCalStr(number);
+    /* The method converts numbers to arithmetic string, appending it to a buffer. */
+    template <class number>
+    friend void toCalStr(number, String &);
     /* The method converts Unicode values into characters. */
     friend char fromCharCode(const unsigned);
     private:
-        char *_proto_; // c-string data
+        static const unsigned INLINE_CAPACITY = 15; // most tokens fit without touching the heap
+        char *_proto_; // c-string data, points at _inline_ for short strings
+        unsigned _capacity_; // characters _proto_ can hold, not counting '\0'
+        char _inline_[INLINE_CAPACITY + 1];
+        void init();
         void assign(const char *);
+        void assign(const char *, const unsigned);
+        void append(const char *, const unsigned);
+        void grow(const unsigned);
+        void release();
     public:
         /* The length property returns the length of a string (number of characters). */
         unsigned length;
@@ -25,19 +72,21 @@ typedef class String {
         String(const char *str);
         String(const char);
         String(const String &str);
+        String(String &&str);
         ~String();
         
         operator char*();
         operator const char*();
 
         char& operator[] (const int);
-        String operator+ (const char *);
-        String operator+ (const String &);
-        String operator+= (const char *);
-        String operator+= (const char);
-        String operator+= (const String &);
-        String operator= (const char *);
-        String operator= (const String &);
+        String operator+ (const char *) const;
+        String operator+ (const String &) const;
+        String& operator+= (const char *);
+        String& operator+= (const char);
+        String& operator+= (const String &);
+        String& operator= (const char *);
+        String& operator= (const String &);
+        String& operator= (String &&);
         bool operator== (const char *);
         bool operator== (const String &);
         bool operator!= (const char *);
@@ -55,6 +104,8 @@ typedef class String {
         String concat(const _type_string);
         /* The method retunrs the value of c-string. */
         char * cstring();
+        /* The method makes room for at least n characters, so appending up to n does not reallocate. */
+        void reserve(const unsigned);
         /* The method determines whether a string ends with the characters of a specified string. */
         template<class _type_string>
         bool endsWith(const _type_string, unsigned=-1);
@@ -93,6 +144,13 @@ typedef class String {
         int search(const _type_string);
         /* The method extracts parts of a string and returns the extracted parts in a new string. */
         String slice(const unsigned, unsigned=-1);
+        /* The method returns a view of the whole string, without copying it. */
+        StringView view() const;
+        /* The method is slice() returning a view into this string instead of a copy. */
+        StringView sliceView(const unsigned, unsigned=-1) const;
+        /* The method is split() returning views into this string instead of copies. */
+        template<class _type_string>
+        Array<StringView> splitView(const _type_string) const;
         /* The method is used to split a string into an array of substrings, and returns the new array. */
         template<class _type_string>
         Array<String> split(const _type_string);
@@ -124,30 +182,121 @@ typedef class String {
 } string;
 
 /* constructor */
-String::String() {
-    _proto_ = NULL;
+StringView::StringView() {
+    data = "";
     length = 0;
 }
 
+StringView::StringView(const char *str) {
+    data = str ? str : "";
+    length = strlen(data);
+}
+
+StringView::StringView(const char *str, const unsigned n) {
+    data = str;
+    length = n;
+}
+
+/* call operators */
+char StringView::operator[] (const int index) const {return data[index];}
+
+/* processing operators: FRIEND */
+std::ostream& operator<< (std::ostream &out, const StringView &str) {
+    out.write(str.data, str.length);
+    return out;
+}
+
+/* processing operators: OVERLOAD */
+bool StringView::operator== (const StringView &str) const {
+    return length == str.length && memcmp(data, str.data, length) == 0;
+}
+
+bool StringView::operator== (const char *str) const {
+    return *this == StringView(str);
+}
+
+bool StringView::operator!= (const StringView &str) const {
+    return !(*this == str);
+}
+
+bool StringView::operator!= (const char *str) const {
+    return !(*this == StringView(str));
+}
+
+/* class methods: BUILT-IN */
+int StringView::indexOf(const char c, const unsigned start) const {
+    for (unsigned i = start; i < length; i++) {
+        if (data[i] == c) return i;
+    }
+
+    return -1;
+}
+
+StringView StringView::slice(const unsigned start, unsigned end) const {
+    if (end > length) end = length;
+    if (start >= end) return StringView(data + length, 0);
+
+    return StringView(data + start, end - start);
+}
+
+Array<StringView> StringView::split(const StringView &sep) const {
+    Array<StringView> splited;
+
+    unsigned splitIndex = 0;
+    for (unsigned i = 0; sep.length > 0 && i + sep.length <= length; i++) {
+        if (memcmp(data + i, sep.data, sep.length) == 0) {
+            splited.push(this->slice(splitIndex, i));
+            splitIndex = i + sep.length;
+            i += sep.length - 1;
+        }
+    }
+
+    splited.push(this->slice(splitIndex));
+
+    return splited;
+}
+
+bool StringView::startsWith(const StringView &str, const unsigned start) const {
+    return start + str.length <= length && memcmp(data + start, str.data, str.length) == 0;
+}
+
+String StringView::toString() const {
+    String result;
+
+    result.reserve(length);
+    for (unsigned i = 0; i < length; i++)
+        result += data[i];
+
+    return result;
+}
+
+/* constructor */
+String::String() {
+    init();
+}
+
 String::String(const char *str) {
+    init();
     this->assign(str);
 }
 
 String::String(const char c) {
-    length = 1;
-
-    _proto_ = new char[2];
-
-    _proto_[0] = c;
-    _proto_[1] = '\0';
+    init();
+    this->assign(&c, 1);
 }
 
 String::String(const String &str) {
-    this->assign(str._proto_);
+    init();
+    this->assign(str._proto_, str.length);
+}
+
+String::String(String &&str) {
+    init();
+    *this = std::move(str);
 }
 
 String::~String() {
-    delete[] _proto_;
+    release();
 }
 
 /* call operators */
@@ -165,131 +314,101 @@ std::istream& operator>> (std::istream &in, String &str) {
     std::string t;
     in >> t;
     
-    str.assign(t.c_str());
+    str.assign(t.c_str(), t.length());
     
     return in;
 }
 
 std::istream& getline(std::istream &in, String &str) {
     std::string t;
-    std::getline(std::cin, t);
+    std::getline(in, t);
     
-    str.assign(t.c_str());
+    str.assign(t.c_str(), t.length());
     
     return in;
 }
 
 /* processing operators: OVERLOAD */
-String operator+ (const char *lstr, String &rstr) {
+String operator+ (const char *lstr, const String &rstr) {
     unsigned llength = strlen(lstr);
+    String result;
 
-    char result[llength+rstr.length+1];
-    result[llength+rstr.length] = '\0';
-
-    for (unsigned i = 0; i < llength; i++)
-        result[i] = lstr[i];
-    for (unsigned i = 0; i < rstr.length; i++)
-        result[rstr.length+i] = rstr._proto_[i];
-
-    rstr._proto_ = result;
-    rstr.length += llength;
+    result.reserve(llength + rstr.length);
+    result.append(lstr, llength);
+    result.append(rstr._proto_, rstr.length);
 
     return result;
 }
 
-String String::operator+ (const char *str) {
+String String::operator+ (const char *str) const {
     unsigned inlength = strlen(str);
+    String result;
 
-    char *old = _proto_;
-    _proto_ = new char[length+inlength+1];
-    _proto_[length+inlength] = '\0';
-
-    for (unsigned i = 0; i < length; i++)
-        _proto_[i] = old[i];
-    for (unsigned i = 0; i < inlength; i++)
-        _proto_[length+i] = str[i];
-
-    delete[] old;
-    length += inlength;
+    result.reserve(length + inlength);
+    result.append(_proto_, length);
+    result.append(str, inlength);
     
-    return _proto_;
+    return result;
 }
 
-String String::operator+ (const String &str) {
-    char *old = _proto_;
-    _proto_ = new char[length+str.length+1];
-    _proto_[length+str.length] = '\0';
+String String::operator+ (const String &str) const {
+    String result;
 
-    for (unsigned i = 0; i < length; i++)
-        _proto_[i] = old[i];
-    for (unsigned i = 0; i < str.length; i++)
-        _proto_[length+i] = str._proto_[i];
-
-    delete[] old;
-    length += str.length;
+    result.reserve(length + str.length);
+    result.append(_proto_, length);
+    result.append(str._proto_, str.length);
     
-    return _proto_;
+    return result;
 }
 
 /* ### */
 
-String String::operator+= (const char *str) {
-    unsigned inlength = strlen(str);
-
-    char *old = _proto_;
-    _proto_ = new char[length+inlength+1];
-    _proto_[length+inlength] = '\0';
-
-    for (unsigned i = 0; i < length; i++)
-        _proto_[i] = old[i];
-    for (unsigned i = 0; i < inlength; i++)
-        _proto_[length+i] = str[i];
-
-    delete[] old;
-    length += inlength;
-    
-    return _proto_;
+String& String::operator+= (const char *str) {
+    this->append(str, strlen(str));
+    return *this;
 }
 
-String String::operator+= (const char chr) {
-    char *old = _proto_;
-    _proto_ = new char[(++length)+1];
-    _proto_[length-1] = chr;
+String& String::operator+= (const char chr) {
+    if (length == _capacity_)
+        this->grow(length + 1);
+
+    _proto_[length++] = chr;
     _proto_[length] = '\0';
-    
-    for (unsigned i = 0; i < length-1; i++)
-        _proto_[i] = old[i];
-    
-    delete[] old;
 
-    return _proto_;
+    return *this;
 }
 
-String String::operator+= (const String &str) {
-    char *old = _proto_;
-    _proto_ = new char[length+str.length+1];
-    _proto_[length+str.length] = '\0';
-
-    for (unsigned i = 0; i < length; i++)
-        _proto_[i] = old[i];
-    for (unsigned i = 0; i < str.length; i++)
-        _proto_[length+i] = str._proto_[i];
-
-    delete[] old;
-    length += str.length;
-    
-    return _proto_;
+String& String::operator+= (const String &str) {
+    this->append(str._proto_, str.length);
+    return *this;
 }
 
 /* ### */
 
-String String::operator= (const char *str) {
+String& String::operator= (const char *str) {
     this->assign(str);
     return *this;
 }
 
-String String::operator= (const String &str) {
-    this->assign(str._proto_);
+String& String::operator= (const String &str) {
+    this->assign(str._proto_, str.length);
+    return *this;
+}
+
+String& String::operator= (String &&str) {
+    if (this == &str) return *this;
+
+    if (str._proto_ == str._inline_) {
+        this->assign(str._proto_, str.length);
+    }
+    else {
+        this->release();
+        _proto_ = str._proto_;
+        _capacity_ = str._capacity_;
+        length = str.length;
+    }
+
+    str.init();
     return *this;
 }
 
@@ -342,27 +461,104 @@ String String::operator* (const unsigned mul) {
 }
 
 /* class methods: PRIVATE */
+void String::init() {
+    _proto_ = _inline_;
+    _capacity_ = INLINE_CAPACITY;
+    _inline_[0] = '\0';
+    length = 0;
+}
+
+void String::release() {
+    if (_proto_ != _inline_)
+        delete[] _proto_;
+
+    init();
+}
+
+/* move the text into a buffer of at least n characters (doubling, so appends are amortized O(1)) */
+void String::grow(const unsigned n) {
+    unsigned newCapacity = _capacity_ * 2 > n ? _capacity_ * 2 : n;
+    char *buffer = new char[newCapacity + 1];
+
+    memcpy(buffer, _proto_, length + 1);
+
+    if (_proto_ != _inline_)
+        delete[] _proto_;
+
+    _proto_ = buffer;
+    _capacity_ = newCapacity;
+}
+
 void String::assign(const char *str) {
-    //delete[] _proto_;
+    this->assign(str, str ? strlen(str) : 0);
+}
 
-    length = strlen(str);
+void String::assign(const char *str, const unsigned n) {
+    if (n > _capacity_) { // str may point into our own buffer, so copy before freeing
+        char *buffer = new char[n + 1];
+        memcpy(buffer, str, n);
 
-    _proto_ = new char[length+1];
-        
-    for (unsigned i = 0; i < length+1; i++) {
-        _proto_[i] = str[i];
+        if (_proto_ != _inline_)
+            delete[] _proto_;
+
+        _proto_ = buffer;
+        _capacity_ = n;
+    }
+    else if (n > 0) {
+        memmove(_proto_, str, n);
     }
 
+    length = n;
+    _proto_[length] = '\0';
+}
+
+void String::append(const char *str, const unsigned n) {
+    if (length + n > _capacity_) {
+        if (str >= _proto_ && str < _proto_ + length) { // s += s
+            String copy;
+            copy.assign(str, n);
+            this->grow(length + n);
+            memcpy(_proto_ + length, copy._proto_, n);
+        }
+        else {
+            this->grow(length + n);
+            memcpy(_proto_ + length, str, n);
+        }
+    }
+    else {
+        memmove(_proto_ + length, str, n);
+    }
+
+    length += n;
     _proto_[length] = '\0';
 }
 
 /* class methods: FRIEND */
+void writeNum(String &buffer, const double n) {
+    char digits[32]; // longest shortest form is 24 characters, e.g. -2.2250738585072014e-308
+    std::to_chars_result written = std::to_chars(digits, digits + sizeof(digits), n);
+
+    buffer.append(digits, written.ptr - digits);
+}
+
+/* coefficient form: 1x is written x, -1x is written -x */
+template <class number>
+void toCalStr(number n, String &buffer) {
+    if (n == 1) return;
+    if (n == -1) {
+        buffer += '-';
+        return;
+    }
+
+    writeNum(buffer, n);
+}
+
 template <class number>
 String toCalStr(number n) {
-    if (n == 1) return "";
-    if (n == -1) return "-";
+    String result;
+    toCalStr(n, result);
 
-    return std::to_string(int(n)).c_str();
+    return result;
 }
 
 /* class methods: BUILT-IN */
@@ -389,6 +585,11 @@ String String::concat(const _type_string string1) {
     return result;
 }
 
+void String::reserve(const unsigned n) {
+    if (n > _capacity_)
+        this->grow(n);
+}
+
 template <class _type_string>
 bool String::endsWith(const _type_string searchvalue, unsigned atlength) {
     if (atlength == -1) atlength = length;
@@ -516,6 +717,19 @@ String String::slice(const unsigned start, unsigned end) {
     return result;
 }
 
+StringView String::view() const {
+    return StringView(_proto_, length);
+}
+
+StringView String::sliceView(const unsigned start, unsigned end) const {
+    return this->view().slice(start, end);
+}
+
+template<class _type_string>
+Array<StringView> String::splitView(const _type_string separator) const {
+    return this->view().split(StringView(separator));
+}
+
 template<class _type_string>
 Array<String> String::split(const _type_string separator) {
     string sep(separator);
@@ -1,33 +1,197 @@
 #include <iostream>
 #include <cmath>
+#include <fstream>
 
 #include "klib.array.h"
 #include "klib.string.h"
 #include "klib.number.h"
+#include "expression.h"
+#include "bytecode.h"
+#include "simd.h"
+#include "parallel.h"
 #include "derivative.h"
+#include "simplify.h"
+#include "diffcache.h"
+#include "taylor.h"
+#include "tape.h"
+#include "incremental.h"
+#include "rootfind.h"
+#include "graph.h"
+#include "terms.h"
+#include "mapped.h"
+#include "binary.h"
+#include "batch.h"
+#include "server.h"
+#include "pipeline.h"
 #include "calculation.h"
 
 /* The method recieves user input from fisrt place */
-void userRequest(string &, string &, unsigned);
-/* The method splits input expression into arrays of string */
-array<string> readExpr(string);
+void userRequest(string &, editSession &, Expression &, Expression &, Expression &, string &, unsigned);
 /* The method calcalate the derivative value of implicit expression */
 void implFunc(string);
-array<string> operation(string);
-/* The method classify what operation btw each term*/
 
-int main()
+int main(int argc, char **argv)
 {
+    if (argc > 1 && string_view(argv[1]) == "--batch")
+    { // headless: records from a file or stdin, see batch.h
+        batchStats stats;
+        const char *file = NULL, *library = NULL;
+
+        try
+        {
+            for (int i = 2; i < argc; i++)
+            {
+                if (string_view(argv[i]) == "--library" && i + 1 < argc)
+                    library = argv[++i];
+                else if (string_view(argv[i]) == "--threads" && i + 1 < argc)
+                    evalThreads = batchCount(argv[++i], BATCH_THREADS_MAX, "--threads needs a count from 0 to 1024.");
+                else
+                    file = argv[i];
+            }
+
+            if (threadCount(0) > 1) // stages on their own threads, see pipeline.h
+                stats = file ? runPipelineFile(file, std::cout, library) : runPipeline(std::cin, std::cout, library);
+            else
+                stats = file ? runBatchFile(file, std::cout, library) : runBatch(std::cin, std::cout, library);
+        }
+        catch (const char *error)
+        {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        catch (const std::exception &error) // such as bad_alloc
+        {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+
+        std::cerr << stats.records << " records, " << stats.errors << " errors, " << stats.misses << " expressions compiled, "
+                  << stats.hits << " reused, " << stats.seconds << " s\n";
+
+        return stats.errors ? 2 : 0;
+    }
+
+    if (argc > 3 && string_view(argv[1]) == "--table")
+    { // f and its derivatives at every x of a file, as text or a binary table
+        unsigned order = 0;
+        bool binary = false;
+
+        try
+        {
+            for (int i = 4; i < argc; i++)
+            {
+                if (string_view(argv[i]) == "--binary")
+                    binary = true;
+                else
+                    order = batchCount(argv[i], BATCH_ORDER_MAX, "The order of a table goes from 0 to 64.");
+            }
+
+            Expression f = compileExpr(argv[2]);
+            tableFile(f, argv[3], std::cout, order, binary);
+        }
+        catch (const char *error)
+        {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        catch (const std::exception &error) // such as bad_alloc
+        {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (argc > 1 && string_view(argv[1]) == "--serve")
+    { // resident: records from stdin or the clients of a socket, see server.h
+        const char *socketPath = NULL, *library = NULL;
+
+        try
+        {
+            for (int i = 2; i < argc; i++)
+            {
+                if (string_view(argv[i]) == "--library" && i + 1 < argc)
+                    library = argv[++i];
+                else if (string_view(argv[i]) == "--threads" && i + 1 < argc)
+                    evalThreads = batchCount(argv[++i], BATCH_THREADS_MAX, "--threads needs a count from 0 to 1024.");
+                else
+                    socketPath = argv[i];
+            }
+
+            if (socketPath)
+                serveSocket(socketPath, library); // until killed
+            else
+            {
+                batchStats stats = serveStream(library);
+                std::cerr << stats.records << " records, " << stats.errors << " errors, " << stats.misses << " expressions compiled, "
+                          << stats.hits << " reused\n";
+            }
+        }
+        catch (const char *error)
+        {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        catch (const std::exception &error) // such as bad_alloc
+        {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+
+        return 0;
+    }
+
+    if (argc > 2 && string_view(argv[1]) == "--compile")
+    { // a library of compiled expressions for --batch --library
+        try
+        {
+            compileLibrary(argv[2], std::cout);
+        }
+        catch (const char *error)
+        {
+            std::cerr << error << "\n";
+            return 1;
+        }
+        catch (const std::exception &error) // such as bad_alloc
+        {
+            std::cerr << error.what() << "\n";
+            return 1;
+        }
+
+        return 0;
+    }
+
     /* parts of user input variables */
     string expr = "", numberOfDiff = "";
+    Expression source;   // f itself, for evaluating f^(n) by forward-mode AD
+    Expression compiled; // f^(n), joined from the per-term derivatives of the session
+    Expression raw;      // f^(n) straight from diffExpr, never simplified (see diffRound)
+    editSession session; // f term by term, so option [4] only redoes the terms that changed
 
     /* parts of program variables */
     string blank;
     unsigned option;
     bool isFirstPass = false;
 
-    std::cout << "Enter f(x) = ";
-    getline(std::cin, expr);
+    while (true)
+    {
+        std::cout << "Enter f(x) = ";
+        if (!getline(std::cin, expr))
+            return 1;
+
+        try
+        {
+            editExpr(session, expr, true); // may be an implicit F(x, y) for option [3]
+            break;
+        }
+        catch (const char *error)
+        {
+            std::cout << error << "\n";
+        }
+    }
+    source = sessionExpr(session);
+    compiled = raw = source;
 
     while (true)
     {
@@ -39,7 +203,7 @@ int main()
             std::cout << "------------------------------------------\n";
         }
 
-        std::cout << "Press: \t[1] to evaluate the result.\n\t[2] to derivative the function.\n\t[3] Implicit Function\n";
+        std::cout << "Press: \t[1] to evaluate the result.\n\t[2] to derivative the function.\n\t[3] Implicit Function\n\t[6] to find the roots of f(x) in an interval.\n\t[7] to plot f(x).\n";
 
         if (isFirstPass)
         {
@@ -54,25 +218,55 @@ int main()
             break;
         std::cout << "The result is...\n\n";
 
-        switch (option)
-        {
-        case 1:
-            userRequest(expr, numberOfDiff, 1);
-            break;
-        case 2:
-            userRequest(expr, numberOfDiff, 2);
+        try
+        { // a bad expression or request is reported, and the menu comes back
+            switch (option)
+            {
+            case 1:
+                userRequest(expr, session, source, compiled, raw, numberOfDiff, 1);
+                break;
+            case 2:
+                userRequest(expr, session, source, compiled, raw, numberOfDiff, 2);
+                break;
+            case 3:
+                userRequest(expr, session, source, compiled, raw, numberOfDiff, 3);
+                break;
+            case 6:
+                userRequest(expr, session, source, compiled, raw, numberOfDiff, 6);
+                break;
+            case 7:
+                userRequest(expr, session, source, compiled, raw, numberOfDiff, 7);
+                break;
+            case 4:
+            {
+                string text;
+
+                std::cout << "Enter f(x) = ";
+                getline(std::cin, text);
+                unsigned reused = editExpr(session, text, true), before, after;
+                expr = text;
+                source = sessionExpr(session);
+                std::cout << "(reused " << reused << " of " << session.terms.length << " terms)\n";
+
+                if (numberOfDiff.length == 0)
+                    compiled = raw = source;
+                else
+                { // stay at f^(n), differentiating only the new terms
+                    sessionDiff(session, numberOfDiff.length, raw, compiled, before, after);
+                    expr = exprToStr(compiled);
+                    std::cout << "f^(" << numberOfDiff << ")(x) = " << expr << "\n\n";
+                }
+                continue;
+            }
             break;
-        case 3:
-            userRequest(expr, numberOfDiff, 3);
-            break;
-        case 4:
+            }
+        }
+        catch (const char *error)
         {
-            std::cout << "Enter f(x) = ";
-            getline(std::cin, expr);
+            std::cout << error << "\n\n";
+            isFirstPass = true;
             continue;
         }
-        break;
-        }
 
         if (option == 2)
             std::cout << "f^(" << numberOfDiff << ")(x) = ";
@@ -84,12 +278,8 @@ int main()
     return 0;
 }
 
-void userRequest(string &expr, string &numberOfDiff, unsigned option)
+void userRequest(string &expr, editSession &session, Expression &source, Expression &compiled, Expression &raw, string &numberOfDiff, unsigned option)
 {
-    array<string> terms = readExpr(expr);
-    array<string> expr_sep = operation(expr); //more edit
-
-    // ++ simplify each term
     string result = "";
     double cal_equation = 0;
 
@@ -100,35 +290,89 @@ void userRequest(string &expr, string &numberOfDiff, unsigned option)
         float x;
         std::cout << "Please enter x value to evaluate : ";
         std::cin >> x;
-        for (unsigned short i = 0; i < terms.length; i++)
+
+        if (numberOfDiff.length == 0)
         {
-            if (expr_sep[i] == '+')
-                cal_equation += cal(terms[i], x);
-            else if (expr_sep[i] == '-')
-                cal_equation -= cal(terms[i], x);
-            else if (expr_sep[i] == '*')
-                cal_equation *= cal(terms[i], x);
-            else if (expr_sep[i] == '/')
-                cal_equation /= cal(terms[i], x);
+            Program program = compileProgram(compiled);
+            cal_equation = cal(program, x);
+            std::cout << "f(x) = " << cal_equation;
+        }
+        else
+        { // f, f', ..., f^(n) in one forward pass over f, without the derivative text
+            array<double> derivs;
+
+            for (unsigned k = 0; k <= numberOfDiff.length; k++)
+                derivs.push(0);
+            taylorDerivatives(source, x, numberOfDiff.length, &derivs[0]);
+
+            for (unsigned k = 0; k <= numberOfDiff.length; k++)
+                std::cout << "f" << numberOfDiff.sliceView(0, k) << "(x) = " << derivs[k] << "\n";
         }
-        std::cout << "f(x) = " << cal_equation;
     }
     break;
     case 2:
     { // Diff
-        numberOfDiff += "'";
-        for (unsigned i = 0; i < terms.length; i++)
-        {
-            if (i > 0 && terms[i][0] != '-')
-                result += "+";
+        unsigned before, after;
 
-            result += Diff(terms[i], 'x');
-        }
+        sessionDiff(session, numberOfDiff.length + 1, raw, compiled, before, after);
+        numberOfDiff += "'"; // once f^(n+1) is there
+        expr = exprToStr(compiled);
+        std::cout << "(simplified " << before << " -> " << after << " nodes)\n";
     }
     break;
     case 3:
     { // Impl
-        result = "dy/dx = ";
+        implFunc(expr);
+    }
+    break;
+    case 6:
+    { // Roots of the current f, or of f^(n) after option [2]
+        double a, b;
+        array<double> roots;
+
+        std::cout << "Please enter the interval a b : ";
+        std::cin >> a >> b;
+        std::cin.ignore();
+
+        if (findRoots(compiled, a, b, roots) == 0)
+            std::cout << "No root found in [" << a << ", " << b << "]\n";
+
+        for (unsigned i = 0; i < roots.length; i++)
+            std::cout << "x = " << roots[i] << "\n";
+    }
+    break;
+    case 7:
+    { // Graph: text on the screen, or a .pgm, .ppm or .svg file
+        plotWindow window;
+        string file;
+
+        std::cout << "Please enter xmin xmax ymin ymax : ";
+        std::cin >> window.xmin >> window.xmax >> window.ymin >> window.ymax;
+        std::cout << "Please enter width and height in pixels : ";
+        std::cin >> window.width >> window.height;
+        std::cout << "Please enter a .pgm, .ppm or .svg file name, or - for the screen : ";
+        std::cin >> file;
+        std::cin.ignore();
+
+        if (file == "-")
+        {
+            renderGraph(compiled, window, RENDER_TEXT, std::cout);
+            break;
+        }
+
+        string_view extension = file.sliceView(file.length > 4 ? file.length - 4 : 0);
+        renderFormat format = extension == ".svg" ? RENDER_SVG : extension == ".ppm" ? RENDER_PPM : RENDER_PGM;
+        std::ofstream out(file, std::ios::binary);
+
+        if (!out)
+            throw "Cannot open the graph file.";
+
+        unsigned samples = renderGraph(compiled, window, format, out);
+        out.close();
+        if (!out)
+            throw "Cannot write the graph file.";
+
+        std::cout << samples << " samples written to " << file << "\n";
     }
     break;
     case 4:
@@ -149,75 +393,6 @@ void userRequest(string &expr, string &numberOfDiff, unsigned option)
     }
 }
 
-array<string> readExpr(string expr)
-{
-    array<string> terms;
-    array<string> operation;
-
-    unsigned leftPar = 0, rightPar = 0;
-
-    // pre-reading process
-    expr = expr.replace(" ", "");
-
-    // reading equation process
-    unsigned splitIndex = 0;
-    for (unsigned i = 0; i < expr.length; i++)
-    {
-        if (expr[i] == '(')
-            leftPar++;
-        else if (expr[i] == ')')
-            rightPar++;
-
-        if ((expr[i] == '+' || expr[i] == '-') && expr[i - 1] != '^' && leftPar == rightPar)
-        {
-            terms.push(expr.slice(splitIndex, i));
-            splitIndex = i + (expr[i] == '+' ? 1 : 0);
-
-            if (expr[i] == '+')
-                operation.push("+");
-            if (expr[i] == '-')
-                operation.push("-");
-        }
-
-        if (i >= expr.length - 1)
-        {
-            terms.push(expr.slice(splitIndex, expr.length));
-        }
-    }
-
-    // check for errors
-    if (leftPar != rightPar)
-        throw "Bad arithmetic expression: no complete pair of parentheses ['()'].";
-
-    return terms;
-}
-
-array<string> operation(string term)
-{
-    array<string> term_sep;
-    int leftPar = 0, rightPar = 0;
-
-    for (int i = 0; i < term.length; i++)
-    {
-        if (term[i] == ')')
-            rightPar++;
-        if (term[i] == '(')
-            leftPar++;
-        if (leftPar == rightPar)
-        {
-            if (term[i] == '+')
-                term_sep.push("+");
-            if (term[i] == '-')
-                term_sep.push("-");
-            if (term[i] == '*')
-                term_sep.push("*");
-            if (term[i] == '/')
-                term_sep.push("/");
-        }
-    }
-    return term_sep;
-}
-
 void implFunc(string t)
 {
     int choice;
@@ -227,17 +402,30 @@ void implFunc(string t)
     std::cin >> choice;
     std::cin.ignore();
 
+    if (choice != 1 && choice != 2)
+    {
+        std::cout << "Please enter 1 or 2";
+        return;
+    }
+
+    Expression F = compileExpr(t, true);
+    gradTape tape;
+    float x, y;
+    double fx, fy;
+
+    std::cout << "Please enter x and y values : ";
+    std::cin >> x >> y;
+    std::cin.ignore();
+
+    recordTape(tape, F);
+    tapeGradient(tape, x, y, fx, fy); // F_x and F_y from one forward and one backward sweep
+
     if (choice == 1)
     { // dy/dx
-        string result = "";
-        readExpr(t);
+        std::cout << "dy/dx = " << -fx / fy << "\n";
     }
-
-    else if (choice == 2)
+    else
     { //dx/dy
-        string result = "";
-        readExpr(t);
+        std::cout << "dx/dy = " << -fy / fx << "\n";
     }
-    else
-        std::cout << "Please enter 1 or 2";
 }
\ No newline at end of file
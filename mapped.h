@@ -0,0 +1,176 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Input files read in place. mapFile maps a whole file read-only, and the readers below cut it into lines
+   and numbers as views over the mapping: nothing is copied and nothing is allocated per line, so input runs
+   at the speed the pages come in. The kernel is told the file is read front to back, and pages already read
+   are released as the reader moves on, so a file much larger than memory does not crowd out everything else.
+   Where there is no mmap the file is read into one buffer instead. */
+
+/* bytes behind the reader that are kept mapped before they are released */
+const size_t MAPPED_RELEASE = (size_t)64 << 20;
+
+struct mappedFile
+{
+    const char *data;
+    size_t size;
+    size_t released; // bytes from the start already given back, a multiple of the page size
+};
+
+/* The method maps a file, and throws if it cannot be opened. An empty file is a mapping of size 0. */
+void mapFile(const char *path, mappedFile &file)
+{
+    file.data = NULL;
+    file.size = file.released = 0;
+
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        throw "Cannot open the input file.";
+    }
+
+    file.size = info.st_size;
+    if (file.size > 0)
+    {
+        void *data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            throw "Cannot map the input file.";
+        }
+
+        madvise(data, file.size, MADV_SEQUENTIAL);
+        file.data = (const char *)data;
+    }
+
+    close(fd); // the mapping keeps the file
+#else
+    FILE *in = fopen(path, "rb");
+
+    if (!in)
+        throw "Cannot open the input file.";
+
+    fseek(in, 0, SEEK_END);
+    file.size = ftell(in);
+    fseek(in, 0, SEEK_SET);
+
+    char *data = new char[file.size + 1];
+    file.size = fread(data, 1, file.size, in);
+    file.data = data;
+    fclose(in);
+#endif
+}
+
+void unmapFile(mappedFile &file)
+{
+#ifndef _WIN32
+    if (file.data)
+        munmap((void *)(file.data + file.released), file.size - file.released);
+#else
+    delete[] file.data;
+#endif
+    file.data = NULL;
+    file.size = file.released = 0;
+}
+
+/* The method gives back the pages before offset, once MAPPED_RELEASE bytes have piled up behind it. */
+void releaseMapped(mappedFile &file, size_t offset)
+{
+#ifndef _WIN32
+    size_t page = sysconf(_SC_PAGESIZE);
+
+    if (offset - file.released < MAPPED_RELEASE)
+        return;
+
+    size_t end = offset / page * page;
+    munmap((void *)(file.data + file.released), end - file.released);
+    file.released = end;
+#else
+    (void)file;
+    (void)offset;
+#endif
+}
+
+/* a position in a mapped file */
+struct mappedReader
+{
+    mappedFile *file;
+    size_t pos;
+};
+
+/* The method sets line to the next line, without its end of line, and returns false at the end of the file.
+   A line is a view into the mapping; it stays valid until the next call, which may give back the pages before
+   the line it returns, or, without release, until the caller gives the pages back itself with releaseMapped. */
+bool nextLine(mappedReader &reader, string_view &line, bool release = true)
+{
+    mappedFile &file = *reader.file;
+
+    if (reader.pos >= file.size)
+        return false;
+
+    const char *begin = file.data + reader.pos;
+    const char *newline = (const char *)memchr(begin, '\n', file.size - reader.pos);
+    size_t length = newline ? newline - begin : file.size - reader.pos;
+
+    reader.pos += length + (newline != NULL);
+    if (length > 0 && begin[length - 1] == '\r')
+        length--;
+    if (length > 0xffffffffu) // a view holds at most 4 GB
+        throw "Bad input: line too long.";
+
+    line = string_view(begin, (unsigned)length);
+    if (release)
+        releaseMapped(file, begin - file.data); // the lines before this one; the page it starts on stays
+
+    return true;
+}
+
+/* The method parses up to count numbers, separated by white space or commas, from the reader into
+   numbers, and returns how many it read; fewer than count only at the end of the file. It throws on
+   anything that is not a number rather than reading it as 0. */
+unsigned nextNumbers(mappedReader &reader, double *numbers, unsigned count)
+{
+    mappedFile &file = *reader.file;
+    unsigned n = 0;
+
+    while (n < count)
+    {
+        while (reader.pos < file.size && (file.data[reader.pos] == ' ' || file.data[reader.pos] == ',' || file.data[reader.pos] == '\t' ||
+                                          file.data[reader.pos] == '\n' || file.data[reader.pos] == '\r'))
+            reader.pos++;
+
+        size_t start = reader.pos;
+        while (reader.pos < file.size && file.data[reader.pos] != ' ' && file.data[reader.pos] != ',' && file.data[reader.pos] != '\t' &&
+               file.data[reader.pos] != '\n' && file.data[reader.pos] != '\r')
+            reader.pos++;
+
+        if (reader.pos == start)
+            break;
+
+        if (reader.pos - start > 0xffffffffu || !isWholeNum(file.data + start, (unsigned)(reader.pos - start)))
+            throw "Bad input: not a number.";
+
+        numbers[n++] = parseNum(file.data + start, (unsigned)(reader.pos - start));
+    }
+
+    releaseMapped(file, reader.pos);
+    return n;
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "klib.array.h"
+#include "klib.string.h"
+#include "klib.number.h"
+#include "mapped.h"
+
+/* Test of reading a file larger than MAPPED_RELEASE through mapped.h, so that pages are given back while
+   it is read: every line nextLine returns, and every number nextNumbers returns, must be the one written.
+   Lines have lengths from 1 to 300 so that they start and end anywhere within a page. Exits with 1 on
+   the first wrong line or number; a page given back too early shows as a crash instead.
+   Usage: mapped_test [megabytes], at least 65 */
+
+/* The method writes line n, without its end of line, into text and returns its length. */
+unsigned testLine(unsigned long long n, char *text)
+{
+    unsigned length = snprintf(text, 32, "%llu", n), total = 1 + n * 7919 % 300;
+
+    while (length < total)
+        text[length++] = 'a' + (n + length) % 26;
+
+    return length < total ? length : total;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long megabytes = argc > 1 ? strtoull(argv[1], NULL, 10) : 80, lines = 0, bytes = 0;
+    char path[] = "/tmp/mapped_testXXXXXX", text[512];
+    int fd = mkstemp(path);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+
+    if (out == NULL)
+    {
+        printf("cannot create %s\n", path);
+        return 1;
+    }
+
+    if (megabytes << 20 <= MAPPED_RELEASE)
+        megabytes = (MAPPED_RELEASE >> 20) + 1;
+
+    while (bytes < megabytes << 20)
+    {
+        unsigned length = testLine(lines++, text);
+
+        text[length++] = '\n';
+        fwrite(text, 1, length, out);
+        bytes += length;
+    }
+    fclose(out);
+
+    int failed = 0;
+    try
+    {
+        mappedFile file;
+        mappedReader reader = {&file, 0};
+        string_view line;
+        unsigned long long n = 0;
+
+        mapFile(path, file);
+        for (; nextLine(reader, line); n++)
+        {
+            unsigned length = testLine(n, text);
+
+            if (line.length != length || memcmp(line.data, text, length) != 0)
+            {
+                printf("nextLine: line %llu is wrong\n", n + 1);
+                failed = 1;
+                break;
+            }
+        }
+        unmapFile(file);
+
+        if (!failed && n != lines)
+        {
+            printf("nextLine: %llu lines, expected %llu\n", n, lines);
+            failed = 1;
+        }
+
+        // the numbers at the start of each line, read as a column from a file of just them
+        out = fopen(path, "w");
+        for (n = 0, bytes = 0; bytes < megabytes << 20; n++)
+            bytes += fprintf(out, "%llu\n", n);
+        fclose(out);
+
+        double numbers[1000];
+        unsigned long long expected = 0, count;
+
+        reader.pos = 0;
+        mapFile(path, file);
+        while (!failed && (count = nextNumbers(reader, numbers, 1000)) > 0)
+        {
+            for (unsigned i = 0; i < count; i++, expected++)
+            {
+                if (numbers[i] != (double)expected)
+                {
+                    printf("nextNumbers: number %llu is wrong\n", expected + 1);
+                    failed = 1;
+                    break;
+                }
+            }
+        }
+        unmapFile(file);
+
+        if (!failed && expected != n)
+        {
+            printf("nextNumbers: %llu numbers, expected %llu\n", expected, n);
+            failed = 1;
+        }
+    }
+    catch (const char *error)
+    {
+        printf("%s\n", error);
+        failed = 1;
+    }
+
+    remove(path);
+    printf("mapped: %llu lines over %llu MB, %s\n", lines, megabytes, failed ? "failed" : "ok");
+    return failed;
+}
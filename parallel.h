@@ -0,0 +1,179 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+/* number of threads used by the parallel evaluators; 0 = one per core */
+unsigned evalThreads = 0;
+/* number of x values handed to a thread at a time */
+const unsigned PARALLEL_CHUNK = 16384;
+
+/* The method resolves a requested thread count (0 = evalThreads, then one per core). */
+unsigned threadCount(unsigned requested)
+{
+    if (requested == 0)
+        requested = evalThreads;
+    if (requested == 0)
+        requested = std::thread::hardware_concurrency();
+
+    return requested == 0 ? 1 : requested;
+}
+
+/* chunks [begin, end) still owned by one worker; the owner takes from the front, thieves from the back */
+struct stealRange
+{
+    std::mutex lock;
+    unsigned begin;
+    unsigned end;
+};
+
+bool takeChunk(stealRange &range, unsigned &chunk)
+{
+    std::lock_guard<std::mutex> guard(range.lock);
+
+    if (range.begin == range.end)
+        return false;
+
+    chunk = range.begin++;
+    return true;
+}
+
+/* The method moves the back half of the first non-empty victim's chunks into ranges[self]. */
+bool stealChunks(stealRange *ranges, unsigned workers, unsigned self)
+{
+    for (unsigned i = 1; i < workers; i++)
+    {
+        stealRange &victim = ranges[(self + i) % workers];
+        unsigned begin, end;
+        {
+            std::lock_guard<std::mutex> guard(victim.lock);
+
+            if (victim.begin == victim.end)
+                continue;
+
+            begin = victim.begin + (victim.end - victim.begin) / 2;
+            end = victim.end;
+            victim.end = begin;
+        }
+
+        std::lock_guard<std::mutex> guard(ranges[self].lock);
+        ranges[self].begin = begin;
+        ranges[self].end = end;
+
+        return true;
+    }
+
+    return false;
+}
+
+/* The method calls body(begin, end) over [0, count) in chunks of chunkSize on a work-stealing pool.
+   Chunk boundaries depend only on count and chunkSize, never on the thread count or timing. The first
+   exception body throws stops the chunks not yet started and is thrown again once every worker is joined. */
+template <class Body>
+void parallelFor(unsigned count, unsigned chunkSize, Body body, unsigned threads = 0)
+{
+    unsigned chunks = (count + chunkSize - 1) / chunkSize;
+    unsigned workers = threadCount(threads);
+
+    if (workers > chunks)
+        workers = chunks;
+    if (workers <= 1)
+    {
+        for (unsigned c = 0; c < chunks; c++)
+            body(c * chunkSize, c == chunks - 1 ? count : (c + 1) * chunkSize);
+        return;
+    }
+
+    stealRange *ranges = new stealRange[workers];
+    for (unsigned t = 0; t < workers; t++)
+    {
+        ranges[t].begin = (unsigned long long)chunks * t / workers;
+        ranges[t].end = (unsigned long long)chunks * (t + 1) / workers;
+    }
+
+    std::exception_ptr error;
+    std::mutex errorLock;
+    std::atomic<bool> failed(false);
+
+    auto work = [&](unsigned self) {
+        unsigned c;
+
+        while (!failed.load(std::memory_order_relaxed))
+        {
+            if (!takeChunk(ranges[self], c))
+            {
+                if (!stealChunks(ranges, workers, self))
+                    break;
+                continue;
+            }
+
+            try
+            {
+                body(c * chunkSize, c == chunks - 1 ? count : (c + 1) * chunkSize);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(errorLock);
+
+                if (!error)
+                    error = std::current_exception();
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+
+    std::thread *pool = new std::thread[workers - 1];
+    unsigned started = 0;
+
+    try
+    {
+        for (; started < workers - 1; started++)
+            pool[started] = std::thread(work, started + 1);
+    }
+    catch (...) // out of threads: the workers that did start steal the chunks of those that did not
+    {
+    }
+
+    work(0);
+
+    for (unsigned t = 0; t < started; t++)
+        pool[t].join();
+
+    delete[] pool;
+    delete[] ranges;
+
+    if (error)
+        std::rethrow_exception(error);
+}
+
+#ifdef BYTECODE_H // the scheduler above is also used without the bytecode, e.g. by polyroots.h
+
+/* The method evaluates a program over count x values on all threads. */
+/* Note: every point goes through runProgramSimd(level), so the result does not depend on threads. */
+void runProgramParallel(Program &prog, const double *x, double *result, unsigned count, unsigned threads = 0, int level = -1)
+{
+    parallelFor(count, PARALLEL_CHUNK, [&](unsigned begin, unsigned end) {
+        runProgramSimd(prog, x + begin, result + begin, end - begin, level);
+    }, threads);
+}
+
+/* The method tabulates result[i] = f(start + i*step) for i < count on all threads, without an x array. */
+void runProgramRange(Program &prog, double start, double step, double *result, unsigned count, unsigned threads = 0, int level = -1)
+{
+    parallelFor(count, PARALLEL_CHUNK, [&](unsigned begin, unsigned end) {
+        double *x = new double[end - begin];
+
+        for (unsigned i = begin; i < end; i++)
+            x[i - begin] = start + i * step;
+
+        runProgramSimd(prog, x, result + begin, end - begin, level);
+        delete[] x;
+    }, threads);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,99 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+#include "klib.array.h"
+#include "klib.string.h"
+#include "klib.number.h"
+
+/* Conformance test of parseNum against strtod: every case must give the same double, bit for bit.
+   The cases are fixed ones around the edges (halfway points, more digits than fit in 64 bits, subnormals,
+   overflow and underflow) followed by random ones: random doubles written with 1 to 17 significant digits,
+   and random digit strings with a random point and exponent. Prints the first mismatches and a summary,
+   and exits with 1 if there was any.
+   Usage: parsenum_test [random cases] */
+
+const char *fixedCases[] = {
+    "0", "0.0", "-0", "1", "-1", "0.1", ".5", "5.", "00012.500", "1E5", "3.14159e+2", "-1.5e-3", "0.30000000000000004",
+    "9007199254740992", "9007199254740993", "9007199254740994", "9007199254740995", "9007199254740993.0000000001",
+    "18446744073709551615", "18446744073709551616", "123456789012345678901234567890",
+    "0.1000000000000000055511151231257827", "0.1000000000000000055511151231257828",
+    "1e22", "1e23", "8.98846567431158e307", "1.7976931348623157e308", "1.7976931348623158e308",
+    "1.7976931348623159e308", "1e308", "1e309", "1e400", "2.2250738585072011e-308", "2.2250738585072014e-308",
+    "4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-323", "1e-324",
+    "1e-400", "0.000000000000000000000000000001", "100000000000000000000000000000000000000000000000000e-50",
+    "7.2057594037927933e16", "2.0000000000000004", "1.00000000000000011102230246251565404236316680908203125",
+    "1.00000000000000011102230246251565404236316680908203124", "1.00000000000000011102230246251565404236316680908203126",
+};
+
+/* xorshift64*, so a run is the same on every machine */
+uint64_t testState = 88172645463325252ULL;
+
+uint64_t testRandom()
+{
+    testState ^= testState >> 12;
+    testState ^= testState << 25;
+    testState ^= testState >> 27;
+
+    return testState * 2685821657736338717ULL;
+}
+
+unsigned long long checked = 0, mismatches = 0;
+
+/* The method parses text both ways and reports it if they differ. */
+void checkNum(const char *text)
+{
+    double mine = parseNum(text, strlen(text)), expected = strtod(text, NULL);
+
+    checked++;
+    if (memcmp(&mine, &expected, sizeof(double)) == 0)
+        return;
+
+    if (mismatches++ < 20)
+        printf("mismatch: %s -> %.17g, strtod %.17g\n", text, mine, expected);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned long long cases = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000;
+    char text[128];
+
+    for (unsigned i = 0; i < sizeof fixedCases / sizeof fixedCases[0]; i++)
+        checkNum(fixedCases[i]);
+
+    for (unsigned long long n = 0; n < cases; n++)
+    {
+        if (n % 2 == 0) // a double, rounded to some digits
+        {
+            uint64_t bits = testRandom();
+            double value;
+
+            memcpy(&value, &bits, sizeof value);
+            if (value != value || value - value != 0) // NaN or infinite
+                continue;
+
+            snprintf(text, sizeof text, n % 4 == 0 ? "%.*g" : "%.*e", (int)(testRandom() % 17) + 1, value);
+        }
+        else // digits, a point and an exponent
+        {
+            unsigned digits = testRandom() % 40 + 1, point = testRandom() % (digits + 1), length = 0;
+
+            if (testRandom() % 2)
+                text[length++] = '-';
+            for (unsigned i = 0; i < digits; i++)
+            {
+                if (i == point && i > 0)
+                    text[length++] = '.';
+                text[length++] = '0' + testRandom() % 10;
+            }
+            snprintf(text + length, sizeof text - length, "e%d", (int)(testRandom() % 701) - 350);
+        }
+
+        checkNum(text);
+    }
+
+    printf("parseNum: %llu cases, %llu mismatches\n", checked, mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,432 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+/* The batch mode as a pipeline: records are read, parsed, compiled, evaluated and formatted by stages that
+   run at once, so that while one record is evaluated the next ones are parsed and the ones before are
+   written out. The stages are joined by bounded queues, and a stage waits when the queue it feeds is full:
+       reader -> parse (threads) -> compile (one thread, owner of the cache) -> evaluate (threads) -> format
+   Records travel in chunks of PIPELINE_CHUNK, so the stages hand work over once per chunk rather than once
+   per record. The output is that of runBatchLines, in record order: the format stage puts chunks back in order
+   in a window of PIPELINE_WINDOW chunks, and the reader waits while that many are in flight, so no stage ever
+   waits for the window itself. Since evaluation runs while the cache moves on, the compile stage holds what
+   each record runs (see holdJob) rather than copying it, and the evaluate stage lets go once it is done. Lines
+   are read in place when they stay valid, as those of a mapped file do until the format stage gives their pages
+   back, and otherwise copied into their chunk. Microseconds are those of the compile and evaluate stages. */
+
+/* records read before they are handed on together */
+const unsigned PIPELINE_CHUNK = 64;
+/* chunks each queue between two stages holds */
+const unsigned PIPELINE_QUEUE = 16;
+/* chunks read but not written yet, at most */
+const unsigned PIPELINE_WINDOW = 256;
+
+/* a queue between two stages; pop returns false once the queue is closed and empty */
+template <class T>
+struct stageQueue
+{
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    T ring[PIPELINE_QUEUE];
+    unsigned head;
+    unsigned count;
+    unsigned producers; // the queue closes when the last one is done
+
+    stageQueue(unsigned producerCount);
+    void push(T item);
+    bool pop(T &item);
+    void done();
+};
+
+template <class T>
+stageQueue<T>::stageQueue(unsigned producerCount)
+{
+    head = count = 0;
+    producers = producerCount;
+}
+
+template <class T>
+void stageQueue<T>::push(T item)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    notFull.wait(guard, [&] { return count < PIPELINE_QUEUE; });
+    ring[(head + count) % PIPELINE_QUEUE] = item;
+    count++;
+    notEmpty.notify_one();
+}
+
+template <class T>
+bool stageQueue<T>::pop(T &item)
+{
+    std::unique_lock<std::mutex> guard(lock);
+
+    notEmpty.wait(guard, [&] { return count > 0 || producers == 0; });
+    if (count == 0)
+        return false;
+
+    item = ring[head];
+    head = (head + 1) % PIPELINE_QUEUE;
+    count--;
+    notFull.notify_one();
+
+    return true;
+}
+
+/* The method tells the queue one of its producers is done. */
+template <class T>
+void stageQueue<T>::done()
+{
+    std::lock_guard<std::mutex> guard(lock);
+
+    if (--producers == 0)
+        notEmpty.notify_all();
+}
+
+/* a record on its way through the pipeline */
+struct pipelineRecord
+{
+    unsigned long long number; // line number
+    string_view line; // into the mapped file, or into the text of the chunk
+    bool skip; // blank or a comment
+    bool ok;
+    batchJob job; // its expression is a view into line
+    string results;
+    double micros;
+};
+
+/* records read together; they stay where they are until written */
+struct pipelineChunk
+{
+    unsigned long long index; // chunks read before it
+    unsigned count;
+    std::string text; // the lines of the records, when they are copied
+    pipelineRecord records[PIPELINE_CHUNK];
+};
+
+/* chunks evaluated and not yet written, by index modulo PIPELINE_WINDOW */
+struct pipelineWindow
+{
+    std::mutex lock;
+    std::condition_variable ready; // a chunk was put in, for the format stage
+    std::condition_variable room; // a chunk was written, for the reader
+    pipelineChunk **slots;
+    unsigned long long read; // chunks read so far
+    unsigned long long written;
+    bool finished; // the reader is done; read is the total
+};
+
+/* The method parses chunks until its queue is done. */
+void parseStage(stageQueue<pipelineChunk *> &in, stageQueue<pipelineChunk *> &out)
+{
+    pipelineChunk *chunk;
+
+    while (in.pop(chunk))
+    {
+        for (unsigned i = 0; i < chunk->count; i++)
+        {
+            pipelineRecord &record = chunk->records[i];
+
+            record.skip = batchTrim(record.line).length == 0 || record.line[0] == '#';
+            record.ok = true;
+            record.micros = 0;
+            record.results = "";
+
+            if (record.skip)
+                continue;
+
+            try
+            {
+                batchParse(record.line, record.job);
+            }
+            catch (const char *error)
+            {
+                record.results = error;
+                record.ok = false;
+            }
+        }
+
+        out.push(chunk);
+    }
+
+    out.done();
+}
+
+/* The method compiles the chunks of its queue against the cache, which only this stage touches, and holds
+   what each record runs for the evaluate stage. */
+void compileStage(array<batchEntry> &cache, batchStats &stats, stageQueue<pipelineChunk *> &in, stageQueue<pipelineChunk *> &out)
+{
+    pipelineChunk *chunk;
+
+    while (in.pop(chunk))
+    {
+        for (unsigned i = 0; i < chunk->count; i++)
+        {
+            pipelineRecord &record = chunk->records[i];
+            batchJob &job = record.job;
+
+            if (record.skip || !record.ok)
+                continue;
+
+            auto start = std::chrono::steady_clock::now();
+
+            try
+            {
+                batchPrepare(cache, job, record.results, stats);
+                holdJob(job);
+            }
+            catch (const char *error)
+            {
+                record.results = error;
+                record.ok = false;
+            }
+
+            record.micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        out.push(chunk);
+    }
+
+    out.done();
+}
+
+/* The method evaluates the chunks of its queue and puts them in the window. A record that fails here becomes
+   an error line, as in runBatchLines, instead of ending the program. */
+void evalStage(pipelineWindow &window, stageQueue<pipelineChunk *> &in)
+{
+    pipelineChunk *chunk;
+    array<double> arena; // for slope records, see batchRun
+
+    while (in.pop(chunk))
+    {
+        for (unsigned i = 0; i < chunk->count; i++)
+        {
+            pipelineRecord &record = chunk->records[i];
+
+            if (record.skip || !record.ok)
+                continue;
+
+            auto start = std::chrono::steady_clock::now();
+
+            try
+            {
+                batchRun(record.job, record.results, &arena);
+            }
+            catch (const char *error)
+            {
+                record.results = error;
+                record.ok = false;
+            }
+            catch (const std::exception &error)
+            {
+                record.results = error.what();
+                record.ok = false;
+            }
+
+            dropJob(record.job);
+            record.micros += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        std::lock_guard<std::mutex> guard(window.lock);
+
+        window.slots[chunk->index % PIPELINE_WINDOW] = chunk;
+        window.ready.notify_one();
+    }
+}
+
+/* The method writes the chunks in order as they come into the window, until the reader is done and all are
+   written, and calls release(end) once the lines before end are no longer needed. */
+template <class Release>
+void formatStage(pipelineWindow &window, std::ostream &out, batchStats &stats, Release release)
+{
+    outBuffer *buffer = new outBuffer;
+
+    buffer->out = &out;
+    buffer->length = 0;
+
+    while (true)
+    {
+        pipelineChunk *chunk;
+        {
+            std::unique_lock<std::mutex> guard(window.lock);
+            pipelineChunk *&slot = window.slots[window.written % PIPELINE_WINDOW];
+
+            if (slot == NULL && buffer->length > 0) // write out what is done while waiting for the rest
+            {
+                guard.unlock();
+                bufferFlush(*buffer);
+                guard.lock();
+            }
+
+            window.ready.wait(guard, [&] { return slot != NULL || (window.finished && window.written == window.read); });
+            if (slot == NULL)
+                break;
+
+            chunk = slot;
+            slot = NULL;
+        }
+
+        for (unsigned i = 0; i < chunk->count; i++)
+        {
+            pipelineRecord &record = chunk->records[i];
+
+            if (record.skip)
+                continue;
+            if (!record.ok)
+                stats.errors++;
+
+            bufferFormat(*buffer, "%llu\t%s\t%.2f\t", record.number, record.ok ? "ok" : "error", record.micros);
+            bufferPut(*buffer, record.results, record.results.length);
+            bufferChar(*buffer, '\n');
+        }
+
+        string_view &last = chunk->records[chunk->count - 1].line;
+        release(last.data + last.length);
+        delete chunk;
+
+        std::lock_guard<std::mutex> guard(window.lock);
+        window.written++;
+        window.room.notify_one();
+    }
+
+    bufferFlush(*buffer);
+    delete buffer;
+}
+
+/* The method runs every line nextLine(line) gives through the pipeline, writes the results to out in order and
+   returns the counts and total time, as runBatchLines does. threads is the number of evaluating threads; parsing
+   gets a quarter as many. With copy the lines are only valid until the next call and are copied; without, they
+   are used in place and must stay valid until release(end) says the lines before end are written. */
+template <class NextLine, class Release>
+batchStats runBatchPipeline(std::ostream &out, const char *library, unsigned threads, NextLine nextLine, bool copy, Release release)
+{
+    unsigned evaluators = threadCount(threads), parsers = evaluators / 4 ? evaluators / 4 : 1;
+    array<batchEntry> cache;
+    batchStats stats = {0, 0, 0, 0, 0};
+    pipelineWindow window;
+    stageQueue<pipelineChunk *> *parseQueue = new stageQueue<pipelineChunk *>(1);
+    stageQueue<pipelineChunk *> *compileQueue = new stageQueue<pipelineChunk *>(parsers);
+    stageQueue<pipelineChunk *> *evalQueue = new stageQueue<pipelineChunk *>(1);
+    string_view line;
+    unsigned long long records = 0;
+    auto begin = std::chrono::steady_clock::now();
+
+    makeBatchCache(cache, library);
+
+    window.slots = new pipelineChunk *[PIPELINE_WINDOW];
+    for (unsigned i = 0; i < PIPELINE_WINDOW; i++)
+        window.slots[i] = NULL;
+    window.read = window.written = 0;
+    window.finished = false;
+
+    std::thread *pool = new std::thread[parsers + evaluators + 2];
+    for (unsigned i = 0; i < parsers; i++)
+        pool[i] = std::thread(parseStage, std::ref(*parseQueue), std::ref(*compileQueue));
+    pool[parsers] = std::thread(compileStage, std::ref(cache), std::ref(stats), std::ref(*compileQueue), std::ref(*evalQueue));
+    for (unsigned i = 0; i < evaluators; i++)
+        pool[parsers + 1 + i] = std::thread(evalStage, std::ref(window), std::ref(*evalQueue));
+    pool[parsers + evaluators + 1] = std::thread(formatStage<Release>, std::ref(window), std::ref(out), std::ref(stats), release);
+
+    for (bool more = true; more;)
+    {
+        pipelineChunk *chunk = new pipelineChunk;
+        unsigned ends[PIPELINE_CHUNK]; // of the copied lines within text, which may move while it grows
+
+        chunk->count = 0;
+        while (chunk->count < PIPELINE_CHUNK && (more = nextLine(line)))
+        {
+            pipelineRecord &record = chunk->records[chunk->count];
+
+            record.number = ++records;
+            record.line = line;
+            if (copy)
+            {
+                chunk->text.append(line.data, line.length);
+                ends[chunk->count] = chunk->text.size();
+            }
+            chunk->count++;
+        }
+
+        for (unsigned i = 0, begin = 0; copy && i < chunk->count; begin = ends[i++])
+            chunk->records[i].line = string_view(chunk->text.data() + begin, ends[i] - begin);
+
+        if (chunk->count == 0)
+        {
+            delete chunk;
+            break;
+        }
+
+        {
+            std::unique_lock<std::mutex> guard(window.lock);
+
+            window.room.wait(guard, [&] { return window.read - window.written < PIPELINE_WINDOW; });
+            chunk->index = window.read++;
+        }
+
+        parseQueue->push(chunk);
+    }
+
+    parseQueue->done();
+    {
+        std::lock_guard<std::mutex> guard(window.lock);
+
+        window.finished = true;
+        window.ready.notify_one();
+    }
+
+    for (unsigned i = 0; i < parsers + evaluators + 2; i++)
+        pool[i].join();
+
+    freeBatchCache(cache);
+    stats.records = records;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    delete[] pool;
+    delete[] window.slots;
+    delete parseQueue;
+    delete compileQueue;
+    delete evalQueue;
+
+    return stats;
+}
+
+/* The method runs every record of a stream through the pipeline. */
+batchStats runPipeline(std::istream &in, std::ostream &out, const char *library = NULL, unsigned threads = 0)
+{
+    std::string text;
+
+    return runBatchPipeline(
+        out, library, threads,
+        [&](string_view &line) {
+            if (!std::getline(in, text))
+                return false;
+
+            line = string_view(text.data(), text.size());
+            return true;
+        },
+        true, [](const char *) {});
+}
+
+/* The method runs every record of a file through the pipeline, read in place from its mapping. */
+batchStats runPipelineFile(const char *path, std::ostream &out, const char *library = NULL, unsigned threads = 0)
+{
+    mappedFile file;
+    mappedReader reader = {&file, 0};
+
+    mapFile(path, file);
+    batchStats stats = runBatchPipeline(
+        out, library, threads, [&](string_view &line) { return nextLine(reader, line, false); }, false,
+        [&](const char *end) { releaseMapped(file, end - file.data); });
+    unmapFile(file);
+
+    return stats;
+}
+
+#endif
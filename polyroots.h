@@ -0,0 +1,157 @@
+#ifndef POLYROOTS_H
+#define POLYROOTS_H
+
+#include <complex>
+#include <cmath>
+
+/* All real and complex roots of a real polynomial by Aberth-Ehrlich iteration: every root estimate is
+   refined at once by Newton's step corrected for the other estimates, which converges cubically to simple roots
+   and does not need deflation. Each root comes with an inclusion radius: the discs
+   |z - roots[i]| <= errors[i] together contain every root of the polynomial (counting the rounding error of
+   evaluating it), so a disc that crosses the real axis is reported as a real root.
+   Coefficients are highest power first, as in a*x^3 + b*x^2 + c*x + d = {a, b, c, d}. */
+
+/* iterations allowed beyond the degree before a solve gives up refining */
+const unsigned POLY_MAX_ITERATIONS = 100;
+
+typedef std::complex<double> complexd;
+
+/* a/b without the overflow and NaN handling of the library division, which costs more than the rest of a step */
+complexd polyDivide(complexd a, complexd b)
+{
+    return a * std::conj(b) / std::norm(b);
+}
+
+/* The method evaluates p(z) and p'(z) by Horner's rule, and a bound on the rounding error of p(z). */
+void polyHorner(const double *coef, unsigned degree, complexd z, complexd &p, complexd &dp, double &rounding)
+{
+    double r = sqrt(std::norm(z));
+
+    p = coef[0];
+    dp = 0;
+    rounding = std::abs(coef[0]);
+
+    for (unsigned i = 1; i <= degree; i++)
+    {
+        dp = dp * z + p;
+        p = p * z + coef[i];
+        rounding = rounding * r + std::abs(coef[i]);
+    }
+
+    rounding *= 4 * degree * 1.1102230246251565e-16; // gamma_2n of the running error bound
+}
+
+/* The method finds the roots of coef[0]*x^degree + ... + coef[degree] into roots and their inclusion radii into
+   errors, and returns how many there are: degree less the leading zero coefficients. A root whose disc crosses
+   the real axis is returned with imaginary part 0. Nothing is allocated. */
+unsigned polyRoots(const double *coef, unsigned degree, complexd *roots, double *errors)
+{
+    while (degree > 0 && coef[0] == 0) // a leading zero lowers the degree
+    {
+        coef++;
+        degree--;
+    }
+
+    unsigned zeros = 0;
+    while (zeros < degree && coef[degree - zeros] == 0) // x^k factor: exact roots at 0
+    {
+        roots[zeros] = 0;
+        errors[zeros] = 0;
+        zeros++;
+    }
+
+    unsigned n = degree - zeros;
+    complexd *z = roots + zeros;
+    double *radius = errors + zeros;
+
+    if (n == 0)
+        return degree;
+
+    // start on a circle of the geometric mean radius, off the real axis so conjugate roots can separate
+    double start = pow(std::abs(coef[n] / coef[0]), 1.0 / n);
+    for (unsigned i = 0; i < n; i++)
+    {
+        z[i] = std::polar(start, 6.283185307179586 * i / n + 0.4);
+        radius[i] = -1; // not converged
+    }
+
+    for (unsigned iteration = 0, done = 0; iteration < POLY_MAX_ITERATIONS + n && done < n; iteration++)
+    {
+        for (unsigned i = 0; i < n; i++)
+        {
+            complexd p, dp;
+            double rounding;
+
+            if (radius[i] >= 0) // converged roots stay put, and still steer the others
+                continue;
+
+            polyHorner(coef, n, z[i], p, dp, rounding);
+
+            if (std::norm(p) <= rounding * rounding) // as close as double arithmetic can tell
+            {
+                radius[i] = 0;
+                done++;
+                continue;
+            }
+
+            complexd ratio = polyDivide(p, dp), sum = 0;
+            for (unsigned j = 0; j < n; j++)
+            {
+                if (j != i)
+                    sum += std::conj(z[i] - z[j]) / std::norm(z[i] - z[j]);
+            }
+
+            complexd step = polyDivide(ratio, 1.0 - ratio * sum);
+            z[i] -= step;
+
+            if (std::norm(step) <= 1.9721522630525295e-31 * std::norm(z[i])) // |step| <= 4 eps |z|
+            {
+                radius[i] = 0;
+                done++;
+            }
+        }
+    }
+
+    for (unsigned i = 0; i < n; i++) // disc i: n*|p(z_i)| / |a_n * prod (z_i - z_j)| contains a root
+    {
+        complexd p, dp, prod = coef[0];
+        double rounding;
+
+        polyHorner(coef, n, z[i], p, dp, rounding);
+        for (unsigned j = 0; j < n; j++)
+        {
+            if (j != i)
+                prod *= z[i] - z[j];
+        }
+
+        radius[i] = n * (std::abs(p) + rounding) / std::abs(prod);
+
+        if (std::fabs(z[i].imag()) <= radius[i])
+            z[i] = z[i].real();
+    }
+
+    return degree;
+}
+
+/* The method solves count polynomials of the same degree on all threads. Polynomial k has its coefficients at
+   coefs[k*(degree+1)], and its roots and radii at roots[k*degree] and errors[k*degree]; slots past a
+   lowered degree are set to NaN. */
+void polyRootsBatch(const double *coefs, unsigned degree, unsigned count, complexd *roots, double *errors, unsigned threads = 0)
+{
+    parallelFor(count, 1024, [&](unsigned begin, unsigned end) {
+        for (unsigned k = begin; k < end; k++)
+        {
+            complexd *r = roots + (unsigned long long)k * degree;
+            double *e = errors + (unsigned long long)k * degree;
+            unsigned found = polyRoots(coefs + (unsigned long long)k * (degree + 1), degree, r, e);
+
+            for (unsigned i = found; i < degree; i++)
+            {
+                r[i] = complexd(NAN, NAN);
+                e[i] = NAN;
+            }
+        }
+    }, threads);
+}
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef ROOTFIND_H
+#define ROOTFIND_H
+
+#include <cmath>
+
+/* All roots of an arbitrary f(x) in [a, b]. f is tabulated once on a uniform grid (on all threads); every
+   cell where f changes sign is a bracket, refined on its own by Newton's method with f' from the compiled
+   derivative, falling back to bisection whenever a step would leave the bracket or shrink it too slowly,
+   and stopping as soon as the bracket is as small as double arithmetic allows. A grid point where |f| dips
+   without a sign change is a candidate double root: there the root of f' is found by Brent's method and
+   kept if f vanishes at it, measured against f at the grid points around it rather than over all of [a, b],
+   where a pole would make any dip look like zero. Poles also change sign; they are rejected because |f|
+   grows as the bracket shrinks. */
+
+/* grid cells scanned over [a, b] unless asked otherwise */
+const unsigned ROOT_GRID = 4096;
+/* refinement steps per bracket; bisection alone needs about 60 to exhaust a double */
+const unsigned ROOT_MAX_ITERATIONS = 100;
+/* brackets refined per parallelFor chunk */
+const unsigned ROOT_CHUNK = 64;
+/* largest |f| at the extremum of a dip, relative to f at the grid points around it, kept as a double root */
+const double ROOT_DIP_RATIO = 1e-6;
+
+/* f and f' compiled once and shared read-only by all threads */
+struct rootFinder
+{
+    Program f;
+    Program df;
+};
+
+/* a cell of the grid that may hold a root */
+struct rootBracket
+{
+    double lo;
+    double hi;
+    double flo;
+    double fhi;
+    bool touching; // no sign change: look for a root of f' instead
+};
+
+/* The method compiles f and its derivative, which comes from diffExpr and so from the cache on repeats. */
+rootFinder makeRootFinder(Expression &expr)
+{
+    Expression derivative = diffExpr(expr, 1);
+    rootFinder finder = {compileProgram(expr), compileProgram(derivative)};
+
+    return finder;
+}
+
+/* The method tells whether a and b are nonzero and of opposite signs; unlike a * b < 0 it holds for the
+   tiniest values, whose product underflows to 0. */
+bool oppositeSigns(double a, double b)
+{
+    return a != 0 && b != 0 && !std::isnan(a) && !std::isnan(b) && std::signbit(a) != std::signbit(b);
+}
+
+/* smallest bracket worth splitting around x */
+double rootTolerance(double x)
+{
+    return 4 * 2.220446049250313e-16 * fabs(x) + 1e-300;
+}
+
+/* The method refines a root of f in a bracket with f(lo) and f(hi) of opposite signs by safeguarded Newton. */
+double newtonRoot(rootFinder &finder, double lo, double hi, double flo)
+{
+    if (flo > 0) // keep f(lo) < 0 < f(hi), whichever side lo is on
+    {
+        double t = lo;
+        lo = hi;
+        hi = t;
+    }
+
+    double x = 0.5 * (lo + hi), step = hi - lo, lastStep = step;
+    double fx = runProgram(finder.f, x), dfx = runProgram(finder.df, x);
+
+    for (unsigned iteration = 0; iteration < ROOT_MAX_ITERATIONS; iteration++)
+    {
+        if (fx == 0)
+            return x;
+
+        // bisect when the Newton step leaves the bracket, or would not halve the step before last
+        double toHi = (x - hi) * dfx - fx, toLo = (x - lo) * dfx - fx;
+        if (!std::isfinite(dfx) || (toHi != 0 && toLo != 0 && std::signbit(toHi) == std::signbit(toLo)) || fabs(2 * fx) > fabs(lastStep * dfx))
+        {
+            lastStep = step;
+            step = 0.5 * (hi - lo);
+            x = lo + step;
+        }
+        else
+        {
+            lastStep = step;
+            step = fx / dfx;
+            x -= step;
+        }
+
+        if (fabs(step) <= rootTolerance(x))
+            return x;
+
+        fx = runProgram(finder.f, x);
+        dfx = runProgram(finder.df, x);
+
+        if (fx < 0)
+            lo = x;
+        else
+            hi = x;
+    }
+
+    return x;
+}
+
+/* The method finds a root of prog in a bracket with prog(lo) and prog(hi) of opposite signs by Brent's method. */
+double brentRoot(Program &prog, double lo, double hi, double flo, double fhi)
+{
+    double a = lo, b = hi, c = hi, fa = flo, fb = fhi, fc = fhi, d = b - a, e = d;
+
+    for (unsigned iteration = 0; iteration < ROOT_MAX_ITERATIONS; iteration++)
+    {
+        if ((fb > 0) == (fc > 0)) // c is always on the other side of the root from b
+        {
+            c = a;
+            fc = fa;
+            d = e = b - a;
+        }
+        if (fabs(fc) < fabs(fb)) // b is the best estimate so far
+        {
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+
+        double tol = rootTolerance(b), half = 0.5 * (c - b);
+        if (fabs(half) <= tol || fb == 0)
+            return b;
+
+        if (fabs(e) >= tol && fabs(fa) > fabs(fb)) // try inverse quadratic or secant interpolation
+        {
+            double s = fb / fa, p, q;
+
+            if (a == c)
+            {
+                p = 2 * half * s;
+                q = 1 - s;
+            }
+            else
+            {
+                double r = fb / fc;
+
+                q = fa / fc;
+                p = s * (2 * half * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+
+            if (p > 0)
+                q = -q;
+            else
+                p = -p;
+
+            if (2 * p < fmin(3 * half * q - fabs(tol * q), fabs(e * q)))
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+                d = e = half;
+        }
+        else
+            d = e = half;
+
+        a = b;
+        fa = fb;
+        b += fabs(d) > tol ? d : (half > 0 ? tol : -tol);
+        fb = runProgram(prog, b);
+    }
+
+    return b;
+}
+
+/* The method refines one bracket into a root, or NaN when it holds a pole or no root after all. */
+double refineBracket(rootFinder &finder, rootBracket &bracket)
+{
+    double x;
+
+    if (!bracket.touching)
+    {
+        x = newtonRoot(finder, bracket.lo, bracket.hi, bracket.flo);
+
+        // a pole changes sign too, but f grows instead of vanishing as the bracket closes in
+        return fabs(runProgram(finder.f, x)) <= fmax(fabs(bracket.flo), fabs(bracket.fhi)) ? x : NAN;
+    }
+
+    double dlo = runProgram(finder.df, bracket.lo), dhi = runProgram(finder.df, bracket.hi);
+    if (!(dlo < 0 && dhi > 0) && !(dlo > 0 && dhi < 0))
+        return NAN; // f' has no sign change: a dip, not an extremum in this cell
+
+    x = brentRoot(finder.df, bracket.lo, bracket.hi, dlo, dhi);
+
+    // the extremum is a root only if f nearly vanishes there next to the values around it, whatever their size
+    return fabs(runProgram(finder.f, x)) <= ROOT_DIP_RATIO * fmax(fabs(bracket.flo), fabs(bracket.fhi)) ? x : NAN;
+}
+
+/* The method finds the roots of expr in [a, b] scanning grid cells, appends them to roots in increasing
+   order and returns how many it found. */
+/* Note: two roots closer than (b - a)/grid in the same cell are found as one, or not at all. */
+unsigned findRoots(rootFinder &finder, double a, double b, array<double> &roots, unsigned grid = ROOT_GRID, unsigned threads = 0)
+{
+    if (!(a < b) || grid == 0)
+        return 0;
+
+    double step = (b - a) / grid;
+    double *values = new double[grid + 1];
+
+    runProgramRange(finder.f, a, step, values, grid + 1, threads);
+
+    array<rootBracket> brackets;
+    array<double> found;
+
+    for (unsigned i = 0; i <= grid; i++)
+    {
+        double x = i == grid ? b : a + i * step, f = values[i];
+
+        if (f == 0)
+        {
+            rootBracket exact = {x, x, 0, 0, false};
+            brackets.push(exact);
+        }
+        else if (i > 0 && i < grid && std::signbit(values[i - 1]) == std::signbit(f) && std::signbit(f) == std::signbit(values[i + 1]) &&
+                 fabs(f) < fabs(values[i - 1]) && fabs(f) < fabs(values[i + 1]))
+        {
+            rootBracket dip = {x - step, x + step, values[i - 1], values[i + 1], true};
+            brackets.push(dip);
+        }
+
+        if (i < grid && oppositeSigns(values[i], values[i + 1]))
+        {
+            rootBracket cell = {x, i + 1 == grid ? b : x + step, values[i], values[i + 1], false};
+            brackets.push(cell);
+        }
+    }
+
+    for (unsigned i = 0; i < brackets.length; i++)
+        found.push(NAN);
+
+    parallelFor(brackets.length, ROOT_CHUNK, [&](unsigned begin, unsigned end) {
+        for (unsigned i = begin; i < end; i++)
+            found[i] = brackets[i].lo == brackets[i].hi ? brackets[i].lo : refineBracket(finder, brackets[i]);
+    }, threads);
+
+    unsigned count = 0;
+    double last = -INFINITY;
+
+    for (unsigned i = 0; i < found.length; i++) // brackets are in grid order; a root on a cell edge can be found twice
+    {
+        if (std::isnan(found[i]) || found[i] - last <= 4 * rootTolerance(found[i]))
+            continue;
+
+        roots.push(found[i]);
+        last = found[i];
+        count++;
+    }
+
+    delete[] values;
+    return count;
+}
+
+/* The method finds the roots of expr in [a, b] as above, compiling f and f' first. */
+unsigned findRoots(Expression &expr, double a, double b, array<double> &roots, unsigned grid = ROOT_GRID, unsigned threads = 0)
+{
+    if (!(a < b) || grid == 0)
+        return 0;
+
+    rootFinder finder = makeRootFinder(expr);
+    return findRoots(finder, a, b, roots, grid, threads);
+}
+
+#endif
@@ -0,0 +1,531 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+/* Resident mode: main --serve [socket] takes batch records (see batch.h) from stdin, or from every client of a
+   Unix socket, and answers each with the batch output line, the record number being the line number within
+   its client. Answers are written as they are done, so a client matches them by record number rather than by
+   order. Readers put records on one bounded queue, and stop reading while it is full; a pool of workers (as
+   many as --threads n asks, see threadCount) takes a record and, with it, the queued records of the same
+   expression, and runs them together against one shared cache. Expressions are keyed by their text trimmed and with runs of spaces made one, so "x^2 +  1 " and
+   "x^2 + 1" are compiled once; removing spaces altogether could join "1 2" or "s in" into other tokens.
+   Each set of the cache has its own lock, so workers only wait for each other on the same set.
+   With stdin the server stops at the end of the input, once every record is answered; a socket server runs
+   until it is killed. */
+
+/* records the queue holds before readers wait */
+const unsigned SERVER_QUEUE = 4096;
+/* most records of one expression a worker runs together */
+const unsigned SERVER_BATCH = 64;
+/* queued records a worker looks through for ones of the same expression */
+const unsigned SERVER_SCAN = 256;
+/* bytes a reader asks for at a time */
+const unsigned SERVER_READ = 1 << 16;
+/* bytes of answers a client may leave unread before its records stop being read */
+const size_t SERVER_OUTBOX = (size_t)16 << 20;
+/* milliseconds the socket server waits before accepting again when it is out of descriptors or memory */
+const unsigned SERVER_ACCEPT_RETRY = 100;
+
+/* a client: its answers not written yet, and how many of its records are not answered yet. Each client has
+   a writer thread, so a worker never waits for a client that reads slowly or not at all. */
+struct serverClient
+{
+    int in;
+    int out;
+    bool owned; // a socket, closed and deleted by its writer once everything is written
+    std::mutex lock; // for the fields below
+    std::condition_variable wake; // the writer has answers to write, or the reader room to queue more
+    std::string outbox;
+    unsigned long long pending;
+    bool finished; // nothing more will be read
+};
+
+struct serverRequest
+{
+    serverClient *client;
+    unsigned long long record;
+    string line; // the record with the spaces of its expression removed
+    unsigned keyBegin; // the expression within line
+    unsigned keyEnd;
+    unsigned set; // batchSet of the expression, compared before the text
+};
+
+/* a ring of requests */
+struct serverQueue
+{
+    std::mutex lock;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    serverRequest *ring;
+    unsigned head;
+    unsigned count; // from head, gaps included (see takeGroup)
+    bool closed; // no more requests will come; workers stop once it is empty
+};
+
+/* the cache and its locks, one per set; the counts of a set also stamp its entries (see batchLookup) */
+struct serverCache
+{
+    array<batchEntry> entries;
+    std::mutex *locks;
+    batchStats *stats;
+};
+
+struct server
+{
+    serverQueue queue;
+    serverCache cache;
+    std::thread *workers;
+    unsigned workerCount;
+};
+
+/* The method writes all of data to a file descriptor, and gives up quietly if the other end has gone. */
+void writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        long written = write(fd, data, length);
+
+        if (written <= 0)
+            return;
+
+        data += written;
+        length -= written;
+    }
+}
+
+/* The method trims the expression of a record, the text between its first two ';', makes each run of spaces in
+   it one space and sets the request's key to it. The parser reads one space as it reads several, so the record
+   means what it meant. A record without ';' is kept as it is, and batchRecord will report it. */
+void normalizeRecord(string_view line, serverRequest &request)
+{
+    int first = line.indexOf(';'), second = first < 0 ? -1 : line.indexOf(';', first + 1);
+
+    if (first < 0)
+    {
+        request.line = line.toString();
+        request.keyBegin = request.keyEnd = 0;
+        request.set = 0;
+        return;
+    }
+    if (second < 0)
+        second = line.length;
+
+    string_view expression = batchTrim(line.slice(first + 1, second));
+
+    request.line = line.slice(0, first + 1).toString();
+    request.keyBegin = request.line.length;
+
+    for (unsigned i = 0; i < expression.length; i++)
+    {
+        if (expression[i] != ' ' || expression[i - 1] != ' ') // trimmed, so a space is never first
+            request.line += expression[i];
+    }
+
+    request.keyEnd = request.line.length;
+    if ((unsigned)second < line.length)
+        request.line += line.slice(second).toString();
+
+    request.set = batchSet(request.line.sliceView(request.keyBegin, request.keyEnd));
+}
+
+string_view requestKey(serverRequest &request)
+{
+    return request.line.sliceView(request.keyBegin, request.keyEnd);
+}
+
+/* The method puts requests on the queue, waiting while it is full, and empties requests. */
+void pushRequests(serverQueue &queue, array<serverRequest> &requests)
+{
+    unsigned i = 0;
+
+    while (i < requests.length)
+    {
+        std::unique_lock<std::mutex> guard(queue.lock);
+
+        queue.notFull.wait(guard, [&] { return queue.count < SERVER_QUEUE; });
+        for (; i < requests.length && queue.count < SERVER_QUEUE; i++, queue.count++)
+            queue.ring[(queue.head + queue.count) % SERVER_QUEUE] = std::move(requests[i]);
+
+        guard.unlock();
+        queue.notEmpty.notify_all();
+    }
+
+    requests = array<serverRequest>();
+}
+
+/* The method moves the request at the front of the queue into batch, with the requests of the same expression
+   among the next SERVER_SCAN, as long as batch has room for SERVER_BATCH. The queue must not be empty.
+   A request taken from the middle leaves a gap, a request without a client, that is dropped once it is at
+   the front: moving the others up would cost more than the requests themselves. */
+void takeGroup(serverQueue &queue, array<serverRequest> &batch)
+{
+    batch.push(std::move(queue.ring[queue.head]));
+    queue.head = (queue.head + 1) % SERVER_QUEUE;
+    queue.count--;
+
+    serverRequest &first = batch[batch.length - 1]; // not moved: batch has room for SERVER_BATCH
+    string_view key = requestKey(first);
+    unsigned scan = queue.count < SERVER_SCAN ? queue.count : SERVER_SCAN;
+
+    for (unsigned i = 0; i < scan && batch.length < SERVER_BATCH; i++)
+    {
+        serverRequest &request = queue.ring[(queue.head + i) % SERVER_QUEUE];
+
+        if (request.client && request.set == first.set && requestKey(request) == key)
+        {
+            batch.push(std::move(request));
+            request.client = NULL;
+        }
+    }
+
+    while (queue.count > 0 && queue.ring[queue.head].client == NULL)
+    {
+        queue.head = (queue.head + 1) % SERVER_QUEUE;
+        queue.count--;
+    }
+}
+
+/* The method fills batch with up to SERVER_BATCH requests, those of one expression next to each other (see
+   takeGroup), and returns false once the queue is closed and empty. */
+bool popRequests(serverQueue &queue, array<serverRequest> &batch)
+{
+    std::unique_lock<std::mutex> guard(queue.lock);
+
+    queue.notEmpty.wait(guard, [&] { return queue.count > 0 || queue.closed; });
+    if (queue.count == 0)
+        return false;
+
+    batch.reserve(SERVER_BATCH);
+    while (queue.count > 0 && batch.length < SERVER_BATCH)
+        takeGroup(queue, batch);
+
+    guard.unlock();
+    queue.notFull.notify_all();
+
+    return true;
+}
+
+/* The method writes the answers of a client as they come, until every record of it is answered and written;
+   a socket client is then closed and deleted. */
+void writeClient(serverClient *client)
+{
+    std::string writing;
+    std::unique_lock<std::mutex> guard(client->lock);
+
+    while (true)
+    {
+        client->wake.wait(guard, [&] { return !client->outbox.empty() || (client->finished && client->pending == 0); });
+        if (client->outbox.empty())
+            break;
+
+        writing.swap(client->outbox);
+        guard.unlock();
+        client->wake.notify_all(); // the reader may be waiting for room
+
+        writeAll(client->out, writing.data(), writing.size());
+        writing.clear();
+        guard.lock();
+    }
+
+    guard.unlock();
+    if (client->owned)
+    {
+        close(client->in);
+        delete client;
+    }
+}
+
+/* The method answers batches of requests until the queue is closed and empty. */
+void serverWorker(server &srv)
+{
+    array<serverRequest> batch;
+    std::string answers;
+    string results, answer[SERVER_BATCH];
+    char head[64];
+
+    while (popRequests(srv.queue, batch))
+    {
+        for (unsigned begin = 0, end; begin < batch.length; begin = end) // a group at a time
+        {
+            unsigned set = batch[begin].set;
+
+            for (end = begin + 1; end < batch.length && batch[end].set == set && requestKey(batch[end]) == requestKey(batch[begin]);)
+                end++;
+
+            std::lock_guard<std::mutex> guard(srv.cache.locks[set / BATCH_CACHE_WAYS]);
+            batchStats &stats = srv.cache.stats[set / BATCH_CACHE_WAYS];
+
+            stats.records += end - begin;
+
+            for (unsigned i = begin; i < end; i++)
+            {
+                serverRequest &request = batch[i];
+                auto start = std::chrono::steady_clock::now();
+                bool ok = true;
+
+                results = "";
+                try
+                {
+                    batchRecord(srv.cache.entries, request.line.view(), results, stats);
+                }
+                catch (const char *error)
+                {
+                    results = error;
+                    ok = false;
+                    stats.errors++;
+                }
+                catch (const std::exception &error) // such as bad_alloc; one record fails, not the server
+                {
+                    results = error.what();
+                    ok = false;
+                    stats.errors++;
+                }
+
+                double micros = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+                snprintf(head, sizeof head, "%llu\t%s\t%.2f\t", request.record, ok ? "ok" : "error", micros);
+                answer[i] = head;
+                answer[i] += results;
+                answer[i] += "\n";
+            }
+        }
+
+        // answers of one client go to its writer together, after every cache set is let go
+        for (unsigned i = 0; i < batch.length; i++)
+        {
+            if (batch[i].client == NULL)
+                continue;
+
+            serverClient *client = batch[i].client;
+            unsigned long long answered = 0;
+
+            answers.clear();
+            for (unsigned j = i; j < batch.length; j++)
+            {
+                if (batch[j].client == client)
+                {
+                    answers.append(answer[j], answer[j].length);
+                    batch[j].client = NULL;
+                    answered++;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> guard(client->lock);
+
+                client->outbox += answers;
+                client->pending -= answered;
+                client->wake.notify_all(); // under the lock: the writer may delete the client once it is let go
+            }
+        }
+
+        batch = array<serverRequest>();
+    }
+}
+
+/* The method reads the records of a client until the end of its input, and queues them. */
+void readClient(server &srv, serverClient *client)
+{
+    char *buffer = new char[SERVER_READ];
+    std::string partial; // a line not ended yet
+    array<serverRequest> requests;
+    unsigned long long record = 0;
+
+    auto queueLine = [&](string_view line) {
+        record++;
+        if (batchTrim(line).length == 0 || line[0] == '#') // counted, as in batch mode
+            return;
+
+        serverRequest request;
+        request.client = client;
+        request.record = record;
+        normalizeRecord(line, request);
+
+        requests.push(std::move(request));
+    };
+    auto queueRequests = [&]() { // a read at a time, so readers and workers do not trade every record
+        {
+            std::unique_lock<std::mutex> guard(client->lock);
+
+            client->wake.wait(guard, [&] { return client->outbox.size() < SERVER_OUTBOX; });
+            client->pending += requests.length;
+        }
+        pushRequests(srv.queue, requests);
+    };
+
+    for (long length; (length = read(client->in, buffer, SERVER_READ)) > 0;)
+    {
+        const char *begin = buffer, *end = buffer + length;
+
+        for (const char *newline; (newline = (const char *)memchr(begin, '\n', end - begin)) != NULL; begin = newline + 1)
+        {
+            if (partial.empty())
+                queueLine(string_view(begin, newline - begin));
+            else
+            {
+                partial.append(begin, newline - begin);
+                queueLine(string_view(partial.data(), partial.size()));
+                partial.clear();
+            }
+        }
+
+        partial.append(begin, end - begin);
+        queueRequests();
+    }
+
+    if (!partial.empty())
+        queueLine(string_view(partial.data(), partial.size()));
+    queueRequests();
+
+    delete[] buffer;
+    {
+        std::lock_guard<std::mutex> guard(client->lock);
+        client->finished = true;
+        client->wake.notify_all(); // under the lock, as in serverWorker
+    }
+}
+
+/* The method sets up the queue and the cache, and starts the workers. */
+void startServer(server &srv, const char *library, unsigned threads)
+{
+    srv.queue.ring = new serverRequest[SERVER_QUEUE];
+    srv.queue.head = srv.queue.count = 0;
+    srv.queue.closed = false;
+
+    makeBatchCache(srv.cache.entries, library);
+    srv.cache.locks = new std::mutex[BATCH_CACHE_SIZE / BATCH_CACHE_WAYS];
+    srv.cache.stats = new batchStats[BATCH_CACHE_SIZE / BATCH_CACHE_WAYS];
+    for (unsigned i = 0; i < BATCH_CACHE_SIZE / BATCH_CACHE_WAYS; i++)
+        srv.cache.stats[i] = batchStats{0, 0, 0, 0, 0};
+
+    srv.workerCount = threadCount(threads);
+    srv.workers = new std::thread[srv.workerCount];
+    for (unsigned i = 0; i < srv.workerCount; i++)
+        srv.workers[i] = std::thread(serverWorker, std::ref(srv));
+}
+
+/* The method lets the workers finish what is queued, stops them and returns the totals of the cache. */
+batchStats stopServer(server &srv)
+{
+    {
+        std::lock_guard<std::mutex> guard(srv.queue.lock);
+        srv.queue.closed = true;
+    }
+    srv.queue.notEmpty.notify_all();
+
+    for (unsigned i = 0; i < srv.workerCount; i++)
+        srv.workers[i].join();
+
+    batchStats total = {0, 0, 0, 0, 0};
+    for (unsigned i = 0; i < BATCH_CACHE_SIZE / BATCH_CACHE_WAYS; i++)
+    {
+        total.records += srv.cache.stats[i].records;
+        total.errors += srv.cache.stats[i].errors;
+        total.hits += srv.cache.stats[i].hits;
+        total.misses += srv.cache.stats[i].misses;
+    }
+
+    delete[] srv.workers;
+    freeBatchCache(srv.cache.entries);
+    delete[] srv.cache.stats;
+    delete[] srv.cache.locks;
+    delete[] srv.queue.ring;
+
+    return total;
+}
+
+/* The method serves the records of stdin on stdout, and returns when all are answered. */
+batchStats serveStream(const char *library = NULL, unsigned threads = 0)
+{
+    server srv;
+    serverClient client;
+
+    client.in = 0;
+    client.out = 1;
+    client.owned = false;
+    client.pending = 0;
+    client.finished = false;
+
+    startServer(srv, library, threads);
+    std::thread writer(writeClient, &client);
+    readClient(srv, &client);
+    writer.join();
+
+    return stopServer(srv); // the workers drain the queue before they stop
+}
+
+/* The method serves every client of a Unix socket at path, one reader thread per client. It does not return
+   unless the socket cannot be set up. */
+void serveSocket(const char *path, const char *library = NULL, unsigned threads = 0)
+{
+#ifndef _WIN32
+    struct sockaddr_un address;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (strlen(path) >= sizeof address.sun_path)
+        throw "Bad socket path: too long.";
+    if (listener < 0)
+        throw "Cannot open the socket.";
+
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path); // left by a server before
+
+    if (bind(listener, (struct sockaddr *)&address, sizeof address) != 0 || listen(listener, 64) != 0)
+    {
+        close(listener);
+        throw "Cannot open the socket.";
+    }
+
+    signal(SIGPIPE, SIG_IGN); // a client that leaves early must not stop the server
+
+    server srv;
+    startServer(srv, library, threads);
+
+    while (true)
+    {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0)
+        {
+            // a client that left or a signal is retried at once; running out of descriptors or memory lasts
+            // until some client is done, and retrying at once would only spin
+            if (errno != EINTR && errno != ECONNABORTED)
+                std::this_thread::sleep_for(std::chrono::milliseconds(SERVER_ACCEPT_RETRY));
+            continue;
+        }
+
+        serverClient *client = new serverClient;
+        client->in = client->out = fd;
+        client->owned = true;
+        client->pending = 0;
+        client->finished = false;
+
+        std::thread(writeClient, client).detach();
+        std::thread(readClient, std::ref(srv), client).detach(); // the writer outlives it, and deletes the client
+    }
+#else
+    (void)path;
+    (void)library;
+    (void)threads;
+    throw "Sockets are not supported here; use --serve without a socket.";
+#endif
+}
+
+#endif
@@ -0,0 +1,437 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/* Vectorized batch evaluation: runProgramSimd runs a Program 4 (AVX2) or 8 (AVX-512) doubles per
+   instruction, picking the widest kernel set the CPU supports at run time, and falls back to the
+   scalar runProgramBatch elsewhere.
+
+   Arithmetic (+ - * / and negation) is IEEE exact, so it matches the scalar path bit for bit.
+   The functions are polynomial approximations; worst error against the correctly rounded result,
+   measured over 10^7 random arguments per range:
+     sin, cos       <= 1 ULP      |x| < 8.2e5 (fdlibm kernels, Cody-Waite reduction with tail)
+     tan            <= 2.5 ULP    |x| < 8.2e5 (sin/cos quotient)
+     cot, sec, csc  <= 3 ULP      |x| < 8.2e5 (one more division)
+     ln             <= 1 ULP      normal x > 0 (fdlibm kernel)
+     logN           <= 2.5 ULP    normal x > 0 (ln(x) / ln(N), as in the scalar path)
+     u^n            <= 0.75*|n| ULP for a constant integer |n| <= 8 and normal u^|n| (repeated multiplication),
+                    correctly rounded for n = 0.5 (sqrt)
+   Arguments outside these ranges (huge, zero, negative, denormal, inf, nan) and other exponents
+   are handed lane by lane to libm, so they get libm's result. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+#if SIMD_X86
+
+#include <stdint.h>
+
+#define SIMD_INLINE static inline __attribute__((always_inline))
+
+typedef double vec4d __attribute__((vector_size(32)));
+typedef int64_t vec4i __attribute__((vector_size(32)));
+typedef double vec8d __attribute__((vector_size(64)));
+typedef int64_t vec8i __attribute__((vector_size(64)));
+
+/* Vectors go in by const reference and come out through a reference: by value, a 32- or 64-byte vector
+   crosses function boundaries with an ABI that depends on the target, which GCC warns about (-Wpsabi) even
+   for these always inlined helpers, as the callers are compiled for AVX and the helpers are not. */
+
+/* sin/cos kernels on r + y, |r + y| <= pi/4 (fdlibm __kernel_sin, __kernel_cos); y is the reduction tail */
+template <class vd>
+SIMD_INLINE void simdSinKernel(const vd &r, const vd &y, vd &out)
+{
+    vd z = r * r;
+    vd v = z * r;
+    vd p = 8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)));
+
+    out = r - ((z * (0.5 * y - v * p) - y) - v * -1.66666666666666324348e-01);
+}
+
+template <class vd>
+SIMD_INLINE void simdCosKernel(const vd &r, const vd &y, vd &out)
+{
+    vd z = r * r;
+    vd p = z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 + z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+    vd hz = 0.5 * z;
+    vd w = 1.0 - hz;
+
+    out = w + (((1.0 - w) - hz) + (z * p - r * y));
+}
+
+/* The method reduces x to r + y in [-pi/4, pi/4] with x = r + y + k*pi/2 (fdlibm __ieee754_rem_pio2,
+   medium case) and sets q to k. Exact for |k| < 2^19. */
+template <class vd, class vi>
+SIMD_INLINE void simdReduce(const vd &x, vd &r, vd &y, vi &q)
+{
+    vd k = x * 6.36619772367581382433e-01;
+    k = (k + 6755399441055744.0) - 6755399441055744.0; // round to nearest
+
+    vd t = x - k * 1.57079632673412561417e+00;
+    vd w = k * 6.07710050630396597660e-11;
+    vd u = t - w;
+
+    w = k * 2.02226624879595063154e-21 - ((t - u) - w);
+    r = u - w;
+    y = (u - r) - w;
+
+    q = __builtin_convertvector(k, vi);
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdTrigRange(const vd &x, vi &bad)
+{
+    vd ax = (vd)((vi)x & 0x7fffffffffffffffLL);
+    bad = (vi)(ax > 8.2e5) | (vi)(x != x);
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdSin(const vd &x, vd &out)
+{
+    vd r, y, s, c;
+    vi q;
+
+    simdReduce<vd, vi>(x, r, y, q);
+    simdSinKernel(r, y, s);
+    simdCosKernel(r, y, c);
+
+    vd v = (q & 1) != 0 ? c : s;
+    out = (q & 2) != 0 ? -v : v;
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdCos(const vd &x, vd &out)
+{
+    vd r, y, s, c;
+    vi q;
+
+    simdReduce<vd, vi>(x, r, y, q);
+    simdSinKernel(r, y, s);
+    simdCosKernel(r, y, c);
+
+    vd v = (q & 1) != 0 ? s : c;
+    out = ((q + 1) & 2) != 0 ? -v : v;
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdTan(const vd &x, vd &out)
+{
+    vd r, y, s, c;
+    vi q;
+
+    simdReduce<vd, vi>(x, r, y, q);
+    simdSinKernel(r, y, s);
+    simdCosKernel(r, y, c);
+
+    out = (q & 1) != 0 ? -c / s : s / c;
+}
+
+/* ln (fdlibm __ieee754_log) for normal positive x */
+template <class vd, class vi>
+SIMD_INLINE void simdLog(const vd &x, vd &out)
+{
+    vi bits = (vi)x;
+    vi e = ((bits >> 52) & 0x7ff) - 1023;
+    vd m = (vd)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    vi big = (vi)(m > 1.41421356237309504880);
+
+    m = big != 0 ? m * 0.5 : m;
+    e = e - big; // big is -1 where set
+
+    vd k = __builtin_convertvector(e, vd);
+    vd f = m - 1.0;
+    vd s = f / (2.0 + f);
+    vd z = s * s;
+    vd w = z * z;
+    vd t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+    vd t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 + w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+    vd R = t2 + t1;
+    vd hfsq = 0.5 * f * f;
+
+    out = k * 6.93147180369123816490e-01 - ((hfsq - (s * (hfsq + R) + k * 1.90821492927058770002e-10)) - f);
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdLogRange(const vd &x, vi &bad)
+{
+    bad = (vi)(x < 2.2250738585072014e-308) | (vi)(x > 1.7976931348623157e+308) | (vi)(x != x);
+}
+
+/* The method applies op to count (padded to a multiple of the vector width) values in place,
+   then recomputes the lanes flagged by range with the libm function. */
+#define SIMD_UNARY(vd, vi, kernel, range, scalar)                                    \
+    for (unsigned i = 0; i < padded; i += sizeof(vd) / sizeof(double))               \
+    {                                                                                \
+        vd v, r;                                                                     \
+        vi bad;                                                                      \
+        __builtin_memcpy(&v, b + i, sizeof(vd));                                     \
+        range<vd, vi>(v, bad);                                                       \
+        kernel<vd, vi>(v, r);                                                        \
+        __builtin_memcpy(b + i, &r, sizeof(vd));                                     \
+        for (unsigned j = 0; j < sizeof(vd) / sizeof(double); j++)                   \
+        {                                                                            \
+            if (bad[j])                                                              \
+                b[i + j] = scalar(v[j]);                                             \
+        }                                                                            \
+    }
+
+#define SIMD_BINARY(vd, expr)                                                        \
+    for (unsigned i = 0; i < padded; i += sizeof(vd) / sizeof(double))               \
+    {                                                                                \
+        vd u, v;                                                                     \
+        __builtin_memcpy(&u, a + i, sizeof(vd));                                     \
+        __builtin_memcpy(&v, b + i, sizeof(vd));                                     \
+        u = expr;                                                                    \
+        __builtin_memcpy(a + i, &u, sizeof(vd));                                     \
+    }
+
+double simdCotScalar(double x) { return 1 / tan(x); }
+double simdSecScalar(double x) { return 1 / cos(x); }
+double simdCscScalar(double x) { return 1 / sin(x); }
+
+template <class vd, class vi>
+SIMD_INLINE void simdCot(const vd &x, vd &out)
+{
+    simdTan<vd, vi>(x, out);
+    out = 1.0 / out;
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdSec(const vd &x, vd &out)
+{
+    simdCos<vd, vi>(x, out);
+    out = 1.0 / out;
+}
+
+template <class vd, class vi>
+SIMD_INLINE void simdCsc(const vd &x, vd &out)
+{
+    simdSin<vd, vi>(x, out);
+    out = 1.0 / out;
+}
+
+/* r is zero, subnormal, infinite or NaN: for u^|n| by repeated multiplication digits were lost on the way */
+template <class vd, class vi>
+SIMD_INLINE void simdPowRange(const vd &r, vi &bad)
+{
+    bad = ((vi)(r > -2.2250738585072014e-308) & (vi)(r < 2.2250738585072014e-308)) | (vi)(r > 1.7976931348623157e+308) |
+          (vi)(r < -1.7976931348623157e+308) | (vi)(r != r);
+}
+
+/* The method computes a^n in place for a constant exponent n; lanes flagged by simdPowRange are
+   recomputed with libm. */
+template <class vd, class vi>
+SIMD_INLINE void simdPowConst(double *a, unsigned padded, double n)
+{
+    const unsigned width = sizeof(vd) / sizeof(double);
+    bool isSqrt = n == 0.5;
+    bool isInt = n == (int)n && n >= -8 && n <= 8;
+
+    if (!isSqrt && !isInt)
+    {
+        for (unsigned i = 0; i < padded; i++)
+            a[i] = pow(a[i], n);
+        return;
+    }
+
+    int power = isInt ? (n < 0 ? -(int)n : (int)n) : 0;
+
+    for (unsigned i = 0; i < padded; i += width)
+    {
+        vd u, r;
+        __builtin_memcpy(&u, a + i, sizeof(vd));
+
+        if (isSqrt)
+        {
+            for (unsigned j = 0; j < width; j++)
+                r[j] = u[j] == -__builtin_inf() ? pow(u[j], 0.5) : __builtin_sqrt(u[j]) + 0.0; // pow(-0, 0.5) = +0
+        }
+        else if (power == 0)
+        {
+            for (unsigned j = 0; j < width; j++)
+                r[j] = 1; // pow(nan, 0) = 1
+        }
+        else
+        {
+            vi bad;
+
+            r = u;
+            for (int k = 1; k < power; k++)
+                r = r * u;
+            simdPowRange<vd, vi>(r, bad);
+            if (n < 0)
+            {
+                vi inverseBad;
+
+                r = 1.0 / r;
+                simdPowRange<vd, vi>(r, inverseBad); // a subnormal 1/u^|n| keeps fewer digits
+                bad |= inverseBad;
+            }
+
+            for (unsigned j = 0; j < width; j++)
+            {
+                if (bad[j])
+                    r[j] = pow(u[j], n);
+            }
+        }
+
+        __builtin_memcpy(a + i, &r, sizeof(vd));
+    }
+}
+
+/* The method is the block interpreter of runProgramBatch with every instruction vectorized. */
+template <class vd, class vi>
+SIMD_INLINE void simdRunProgram(Program &prog, const double *x, double *result, unsigned count)
+{
+    const unsigned width = sizeof(vd) / sizeof(double);
+    double *stack = new double[(prog.stackSize + prog.slotCount) * PROGRAM_BLOCK];
+    double *slots = stack + prog.stackSize * PROGRAM_BLOCK;
+    const unsigned *begin = &prog.code[0];
+    const unsigned *end = begin + prog.code.length;
+    const double *constants = prog.constants.length ? &prog.constants[0] : NULL;
+
+    for (unsigned start = 0; start < count; start += PROGRAM_BLOCK)
+    {
+        unsigned n = count - start < PROGRAM_BLOCK ? count - start : PROGRAM_BLOCK;
+        unsigned padded = (n + width - 1) / width * width;
+        const double *xs = x + start;
+        double *top = stack - PROGRAM_BLOCK;
+
+        for (const unsigned *code = begin; code != end; code++)
+        {
+            double *a = top - PROGRAM_BLOCK, *b = top;
+
+            switch (*code & 0xff)
+            {
+            case OP_CONST:
+            {
+                double c = constants[*code >> 8];
+                top += PROGRAM_BLOCK;
+                for (unsigned i = 0; i < padded; i++)
+                    top[i] = c;
+            }
+            break;
+            case OP_X:
+                top += PROGRAM_BLOCK;
+                for (unsigned i = 0; i < padded; i++)
+                    top[i] = i < n ? xs[i] : 1; // padding lanes stay in every function's fast range
+                break;
+            case OP_ADD:
+                SIMD_BINARY(vd, u + v)
+                top = a;
+                break;
+            case OP_SUB:
+                SIMD_BINARY(vd, u - v)
+                top = a;
+                break;
+            case OP_MUL:
+                SIMD_BINARY(vd, u * v)
+                top = a;
+                break;
+            case OP_DIV:
+                SIMD_BINARY(vd, u / v)
+                top = a;
+                break;
+            case OP_POW:
+                if (code != begin && (code[-1] & 0xff) == OP_CONST)
+                    simdPowConst<vd, vi>(a, padded, constants[code[-1] >> 8]);
+                else
+                {
+                    for (unsigned i = 0; i < padded; i++)
+                        a[i] = pow(a[i], b[i]);
+                }
+                top = a;
+                break;
+            case OP_NEG:
+                for (unsigned i = 0; i < padded; i++)
+                    b[i] = -b[i];
+                break;
+            case OP_SIN:
+                SIMD_UNARY(vd, vi, simdSin, simdTrigRange, sin)
+                break;
+            case OP_COS:
+                SIMD_UNARY(vd, vi, simdCos, simdTrigRange, cos)
+                break;
+            case OP_TAN:
+                SIMD_UNARY(vd, vi, simdTan, simdTrigRange, tan)
+                break;
+            case OP_COT:
+                SIMD_UNARY(vd, vi, simdCot, simdTrigRange, simdCotScalar)
+                break;
+            case OP_SEC:
+                SIMD_UNARY(vd, vi, simdSec, simdTrigRange, simdSecScalar)
+                break;
+            case OP_CSC:
+                SIMD_UNARY(vd, vi, simdCsc, simdTrigRange, simdCscScalar)
+                break;
+            case OP_LN:
+                SIMD_UNARY(vd, vi, simdLog, simdLogRange, log)
+                break;
+            case OP_LOG:
+            {
+                double lnBase = constants[*code >> 8];
+                SIMD_UNARY(vd, vi, simdLog, simdLogRange, log)
+                for (unsigned i = 0; i < padded; i++)
+                    b[i] = b[i] / lnBase;
+            }
+            break;
+            case OP_STORE:
+                __builtin_memcpy(slots + (*code >> 8) * PROGRAM_BLOCK, b, padded * sizeof(double));
+                break;
+            case OP_LOAD:
+                top += PROGRAM_BLOCK;
+                __builtin_memcpy(top, slots + (*code >> 8) * PROGRAM_BLOCK, padded * sizeof(double));
+                break;
+            }
+        }
+
+        for (unsigned i = 0; i < n; i++)
+            result[start + i] = stack[i];
+    }
+
+    delete[] stack;
+}
+
+__attribute__((target("avx2,fma"))) void runProgramAvx2(Program &prog, const double *x, double *result, unsigned count)
+{
+    simdRunProgram<vec4d, vec4i>(prog, x, result, count);
+}
+
+__attribute__((target("avx512f"))) void runProgramAvx512(Program &prog, const double *x, double *result, unsigned count)
+{
+    simdRunProgram<vec8d, vec8i>(prog, x, result, count);
+}
+
+#endif
+
+/* The method returns the widest kernel set this CPU runs: 2 = AVX-512, 1 = AVX2, 0 = scalar. */
+int simdLevel()
+{
+#if SIMD_X86
+    static int level = __builtin_cpu_supports("avx512f") ? 2 : (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) ? 1 : 0;
+    return level;
+#else
+    return 0;
+#endif
+}
+
+/* The method evaluates a program over count x values with the vector kernels. */
+/* Note: level caps the kernel set (-1 = best available), e.g. 0 forces the scalar path. */
+void runProgramSimd(Program &prog, const double *x, double *result, unsigned count, int level = -1)
+{
+    if (level < 0 || level > simdLevel())
+        level = simdLevel();
+
+#if SIMD_X86
+    if (level == 2)
+        return runProgramAvx512(prog, x, result, count);
+    if (level == 1)
+        return runProgramAvx2(prog, x, result, count);
+#endif
+
+    runProgramBatch(prog, x, result, count);
+}
+
+#endif
@@ -0,0 +1,560 @@
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+/* Rule-based simplifier, run between the rounds of f^(n):
+     - constant folding of any node whose operands are constants
+     - sums: 0 dropped, like terms collected (3x + x = 4x, u - u = 0), sin(u)^2 + cos(u)^2 = 1
+     - products: 1 dropped, 0 absorbs, powers of the same base merged (x^2*x/x^3 = 1, (x^2)^3 = x^6),
+       tan/cot/sec/csc rewritten through sin and cos of the same argument and back
+       (sin(u)*sec(u) = tan(u), tan(u)*cos(u) = sin(u), sin(u)*csc(u) = 1)
+   Hash-consing makes like terms and equal bases the same node index, so matching is an index compare, and
+   a term or factor finds the earlier one it merges with through a table indexed by node. A chain of +/- (or
+   *,/) is collected once, at its root, so a long sum costs time linear in its length. */
+
+/* a term of a sum: coef * nodes[node], node = -1 for the constant term */
+struct sumTerm
+{
+    double coef;
+    int node;
+};
+
+/* a factor of a product: nodes[base] ^ power */
+struct productFactor
+{
+    int base;
+    double power;
+};
+
+struct simplifyContext
+{
+    Expression *src;
+    Expression *dst;
+    array<int> done; // index in dst of each simplified src node
+    array<int> collected; // per dst node + 1 (0 for the constant term), its place in the terms or factors being collected, or -1
+    array<bool> chainRoot; // per src node, whether some parent is not a sum (or product) like it, so it collects its chain
+};
+
+/* The method gives the kind of chain a node type links into: 1 for sums, 2 for products, 0 for none. */
+int chainKind(int type)
+{
+    if (type == EXPR_ADD || type == EXPR_SUB || type == EXPR_NEG)
+        return 1;
+    if (type == EXPR_MUL || type == EXPR_DIV)
+        return 2;
+    return 0;
+}
+
+/* The method makes collected cover every node of d; entries are -1 between collections. */
+void growCollected(array<int> &collected, Expression &d)
+{
+    collected.reserve(d.nodes.length + 1);
+    while (collected.length < d.nodes.length + 1)
+        collected.push(-1);
+}
+
+/* The method applies an operator to constant operands. */
+double foldConst(exprType type, double a, double b, double base)
+{
+    switch (type)
+    {
+    case EXPR_ADD:
+        return a + b;
+    case EXPR_SUB:
+        return a - b;
+    case EXPR_MUL:
+        return a * b;
+    case EXPR_DIV:
+        return a / b;
+    case EXPR_POW:
+        return pow(a, b);
+    case EXPR_NEG:
+        return -a;
+    case EXPR_SIN:
+        return sin(a);
+    case EXPR_COS:
+        return cos(a);
+    case EXPR_TAN:
+        return tan(a);
+    case EXPR_COT:
+        return 1 / tan(a);
+    case EXPR_SEC:
+        return 1 / cos(a);
+    case EXPR_CSC:
+        return 1 / sin(a);
+    case EXPR_LN:
+        return log(a);
+    case EXPR_LOG:
+        return log(a) / log(base);
+    default:
+        return a;
+    }
+}
+
+/* The method adds coef * node to the terms; merged is set when it combines with an earlier term. */
+void addTerm(array<sumTerm> &terms, array<int> &collected, double coef, int node, bool &merged)
+{
+    int &at = collected[node + 1];
+
+    if (at >= 0)
+    {
+        terms[at].coef += coef;
+        merged = true;
+        return;
+    }
+
+    sumTerm term = {coef, node};
+    at = terms.length;
+    terms.push(term);
+}
+
+/* The method splits an already simplified node into sign * (terms of a sum). */
+void collectTerms(Expression &d, int index, double sign, array<sumTerm> &terms, array<int> &collected, bool &merged)
+{
+    exprNode node = d.nodes[index];
+
+    switch (node.type)
+    {
+    case EXPR_CONST:
+        addTerm(terms, collected, sign * node.value, -1, merged);
+        break;
+    case EXPR_ADD:
+    case EXPR_SUB:
+        collectTerms(d, node.left, sign, terms, collected, merged);
+        collectTerms(d, node.right, node.type == EXPR_SUB ? -sign : sign, terms, collected, merged);
+        break;
+    case EXPR_NEG:
+        collectTerms(d, node.left, -sign, terms, collected, merged);
+        break;
+    case EXPR_MUL:
+        if (d.nodes[node.left].type == EXPR_CONST)
+        {
+            addTerm(terms, collected, sign * d.nodes[node.left].value, node.right, merged);
+            break;
+        }
+        if (d.nodes[node.right].type == EXPR_CONST)
+        {
+            addTerm(terms, collected, sign * d.nodes[node.right].value, node.left, merged);
+            break;
+        }
+        [[fallthrough]]; // no constant factor: a term like any other
+    default:
+        addTerm(terms, collected, sign, index, merged);
+    }
+}
+
+/* The method finds sin(u)^2 and cos(u)^2 terms with the same coefficient and replaces them with it. */
+bool pythagoreanTerms(Expression &d, array<sumTerm> &terms, array<int> &collected)
+{
+    bool found = false;
+
+    for (unsigned i = 0; i < terms.length; i++)
+    {
+        if (terms[i].node < 0 || terms[i].coef == 0)
+            continue;
+
+        exprNode sq = d.nodes[terms[i].node];
+        if (sq.type != EXPR_POW || !isConstNode(d, sq.right, 2) || d.nodes[sq.left].type != EXPR_SIN)
+            continue;
+
+        int arg = d.nodes[sq.left].left;
+        for (unsigned j = 0; j < terms.length; j++)
+        {
+            if (terms[j].node < 0 || terms[j].coef != terms[i].coef)
+                continue;
+
+            exprNode other = d.nodes[terms[j].node];
+            if (other.type == EXPR_POW && isConstNode(d, other.right, 2) && d.nodes[other.left].type == EXPR_COS && d.nodes[other.left].left == arg)
+            {
+                addTerm(terms, collected, terms[i].coef, -1, found);
+                terms[i].coef = 0;
+                terms[j].coef = 0;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    return found;
+}
+
+/* The method rebuilds a sum from its collected terms: variable terms in order, constant last. */
+int buildSum(Expression &d, array<sumTerm> &terms)
+{
+    int result = -1;
+    double constant = 0;
+
+    for (unsigned i = 0; i < terms.length; i++)
+    {
+        if (terms[i].node < 0)
+        {
+            constant += terms[i].coef;
+            continue;
+        }
+        if (terms[i].coef == 0)
+            continue;
+
+        double coef = terms[i].coef;
+        if (result < 0)
+        {
+            result = coef == -1 ? makeUnary(d, EXPR_NEG, terms[i].node) : makeBinary(d, EXPR_MUL, makeConst(d, coef), terms[i].node);
+            continue;
+        }
+
+        int term = makeBinary(d, EXPR_MUL, makeConst(d, coef < 0 ? -coef : coef), terms[i].node);
+        result = makeBinary(d, coef < 0 ? EXPR_SUB : EXPR_ADD, result, term);
+    }
+
+    if (result < 0)
+        return makeConst(d, constant);
+    if (constant != 0)
+        result = makeBinary(d, constant < 0 ? EXPR_SUB : EXPR_ADD, result, makeConst(d, constant < 0 ? -constant : constant));
+
+    return result;
+}
+
+/* The method adds base^power to the factors; merged is set when it combines with an earlier factor. */
+void addFactor(array<productFactor> &factors, array<int> &collected, int base, double power, bool &merged)
+{
+    int &at = collected[base + 1];
+
+    if (at >= 0)
+    {
+        factors[at].power += power;
+        merged = true;
+        return;
+    }
+
+    productFactor factor = {base, power};
+    at = factors.length;
+    factors.push(factor);
+}
+
+/* The method splits an already simplified node into coef * (factors of a product), each raised to sign. */
+void collectFactors(Expression &d, int index, double sign, double &coef, array<productFactor> &factors, array<int> &collected, bool &merged)
+{
+    exprNode node = d.nodes[index];
+
+    switch (node.type)
+    {
+    case EXPR_CONST:
+        if (coef != 1)
+            merged = true;
+        coef *= sign > 0 ? node.value : 1 / node.value;
+        break;
+    case EXPR_NEG:
+        coef = -coef;
+        collectFactors(d, node.left, sign, coef, factors, collected, merged);
+        break;
+    case EXPR_MUL:
+    case EXPR_DIV:
+        collectFactors(d, node.left, sign, coef, factors, collected, merged);
+        collectFactors(d, node.right, node.type == EXPR_DIV ? -sign : sign, coef, factors, collected, merged);
+        break;
+    case EXPR_POW:
+        if (d.nodes[node.right].type == EXPR_CONST)
+        {
+            double power = sign * d.nodes[node.right].value;
+            exprNode inner = d.nodes[node.left];
+
+            if (inner.type == EXPR_POW && d.nodes[inner.right].type == EXPR_CONST && power == floor(power)) // (u^a)^n = u^(a*n)
+            {
+                addFactor(factors, collected, inner.left, power * d.nodes[inner.right].value, merged);
+                merged = true;
+            }
+            else
+                addFactor(factors, collected, node.left, power, merged);
+            break;
+        }
+        [[fallthrough]]; // a variable power: a factor like any other
+    default:
+        addFactor(factors, collected, index, sign, merged);
+    }
+}
+
+/* The method writes sin(u)^sinPower * cos(u)^cosPower as positive powers of sin/csc and cos/sec into factors[i]
+   (and one new factor when both are left). */
+void splitTrig(Expression &d, array<productFactor> &factors, unsigned i, int arg, double sinPower, double cosPower)
+{
+    factors[i].power = 0;
+
+    if (sinPower != 0)
+    {
+        factors[i].base = makeUnary(d, sinPower > 0 ? EXPR_SIN : EXPR_CSC, arg);
+        factors[i].power = sinPower > 0 ? sinPower : -sinPower;
+    }
+    if (cosPower != 0)
+    {
+        int cosBase = makeUnary(d, cosPower > 0 ? EXPR_COS : EXPR_SEC, arg);
+        double cosAbs = cosPower > 0 ? cosPower : -cosPower;
+
+        if (sinPower != 0)
+        {
+            productFactor factor = {cosBase, cosAbs};
+            factors.push(factor);
+        }
+        else
+        {
+            factors[i].base = cosBase;
+            factors[i].power = cosAbs;
+        }
+    }
+}
+
+/* The method rewrites tan, cot, sec and csc factors as powers of sin and cos of the same argument,
+   merges them, and picks the shortest form back: sin^a*cos^-a = tan^a, sin^-1 = csc, ...
+   It returns whether two factors of the same argument were combined. */
+bool trigFactors(Expression &d, array<productFactor> &factors)
+{
+    bool found = false;
+
+    for (unsigned i = 0; i < factors.length; i++)
+    {
+        exprNode base = d.nodes[factors[i].base];
+        if (base.type < EXPR_SIN || base.type > EXPR_CSC || factors[i].power == 0)
+            continue;
+
+        int arg = base.left, original = factors[i].base;
+        double sinPower = 0, cosPower = 0;
+        for (unsigned j = i; j < factors.length; j++)
+        {
+            exprNode other = d.nodes[factors[j].base];
+            double p = factors[j].power;
+
+            if (other.type < EXPR_SIN || other.type > EXPR_CSC || other.left != arg)
+                continue;
+
+            switch (other.type)
+            {
+            case EXPR_SIN:
+                sinPower += p;
+                break;
+            case EXPR_COS:
+                cosPower += p;
+                break;
+            case EXPR_TAN:
+                sinPower += p;
+                cosPower -= p;
+                break;
+            case EXPR_COT:
+                sinPower -= p;
+                cosPower += p;
+                break;
+            case EXPR_SEC:
+                cosPower -= p;
+                break;
+            default: // EXPR_CSC
+                sinPower -= p;
+            }
+            factors[j].power = 0;
+
+            if (j > i)
+                found = true;
+        }
+
+        if (sinPower != 0 && sinPower == -cosPower)
+        {
+            factors[i].base = makeUnary(d, sinPower > 0 ? EXPR_TAN : EXPR_COT, arg);
+            factors[i].power = sinPower > 0 ? sinPower : cosPower;
+        }
+        else
+            splitTrig(d, factors, i, arg, sinPower, cosPower);
+
+        if (factors[i].base != original) // 1/sin(u) = csc(u), ...
+            found = true;
+
+    }
+
+    return found;
+}
+
+/* The method rebuilds coef * numerator / denominator from the collected factors. */
+int buildProduct(Expression &d, double coef, array<productFactor> &factors)
+{
+    int top = -1, bottom = -1;
+
+    if (coef == 0)
+        return makeConst(d, 0);
+
+    for (unsigned i = 1; i < factors.length; i++) // by node index, so u*v and v*u become the same node
+    {
+        productFactor factor = factors[i];
+        unsigned j = i;
+
+        for (; j > 0 && factors[j - 1].base > factor.base; j--)
+            factors[j] = factors[j - 1];
+        factors[j] = factor;
+    }
+
+    for (unsigned i = 0; i < factors.length; i++)
+    {
+        double power = factors[i].power;
+        if (power == 0)
+            continue;
+
+        int factor = makeBinary(d, EXPR_POW, factors[i].base, makeConst(d, power < 0 ? -power : power));
+        int &side = power > 0 ? top : bottom;
+        side = side < 0 ? factor : makeBinary(d, EXPR_MUL, side, factor);
+    }
+
+    if (top < 0 && bottom < 0)
+        return makeConst(d, coef);
+
+    int result = top < 0 ? makeConst(d, 1) : top;
+    if (bottom >= 0)
+        result = makeBinary(d, EXPR_DIV, result, bottom);
+
+    if (coef == -1)
+        return makeUnary(d, EXPR_NEG, result);
+
+    return makeBinary(d, EXPR_MUL, makeConst(d, coef), result);
+}
+
+int simplifyNode(simplifyContext &ctx, int index)
+{
+    if (ctx.done[index] >= 0)
+        return ctx.done[index];
+
+    Expression &d = *ctx.dst;
+    exprNode node = ctx.src->nodes[index];
+    int left = node.left >= 0 ? simplifyNode(ctx, node.left) : -1;
+    int right = node.right >= 0 ? simplifyNode(ctx, node.right) : -1;
+    int result;
+
+    bool constLeft = left >= 0 && d.nodes[left].type == EXPR_CONST;
+    bool constRight = right < 0 || d.nodes[right].type == EXPR_CONST;
+
+    if (node.type == EXPR_CONST || node.type == EXPR_X)
+        result = addNode(d, node.type, node.value, -1, -1);
+    else if (constLeft && constRight)
+        result = makeConst(d, foldConst(node.type, d.nodes[left].value, right >= 0 ? d.nodes[right].value : 0, node.value));
+    else if (chainKind(node.type) && !ctx.chainRoot[index]) // inside a chain, collected once at its root
+        result = right >= 0 ? makeBinary(d, node.type, left, right) : makeUnary(d, node.type, left);
+    else if (node.type == EXPR_ADD || node.type == EXPR_SUB || node.type == EXPR_NEG)
+    {
+        array<sumTerm> terms;
+        bool merged = false;
+
+        growCollected(ctx.collected, d);
+        collectTerms(d, left, node.type == EXPR_NEG ? -1 : 1, terms, ctx.collected, merged);
+        if (right >= 0)
+            collectTerms(d, right, node.type == EXPR_SUB ? -1 : 1, terms, ctx.collected, merged);
+        if (pythagoreanTerms(d, terms, ctx.collected))
+            merged = true;
+        for (unsigned i = 0; i < terms.length; i++)
+            ctx.collected[terms[i].node + 1] = -1;
+
+        if (merged)
+            result = buildSum(d, terms);
+        else
+            result = node.type == EXPR_NEG ? makeUnary(d, EXPR_NEG, left) : makeBinary(d, node.type, left, right);
+    }
+    else if (node.type == EXPR_MUL || node.type == EXPR_DIV)
+    {
+        array<productFactor> factors;
+        double coef = 1;
+        bool merged = false;
+
+        growCollected(ctx.collected, d);
+        collectFactors(d, left, 1, coef, factors, ctx.collected, merged);
+        collectFactors(d, right, node.type == EXPR_DIV ? -1 : 1, coef, factors, ctx.collected, merged);
+        for (unsigned i = 0; i < factors.length; i++) // before trigFactors changes bases
+            ctx.collected[factors[i].base + 1] = -1;
+        if (trigFactors(d, factors))
+            merged = true;
+
+        if (merged)
+            result = buildProduct(d, coef, factors);
+        else
+            result = makeBinary(d, node.type, left, right);
+    }
+    else if (right >= 0)
+        result = makeBinary(d, node.type, left, right);
+    else
+        result = addNode(d, node.type, node.value, left, -1);
+
+    ctx.done[index] = result;
+    return result;
+}
+
+/* The method copies the nodes reachable from index into out (dropping what the rewrite left behind). */
+int compactNode(Expression &expr, int index, Expression &out, array<int> &copied)
+{
+    if (copied[index] >= 0)
+        return copied[index];
+
+    exprNode node = expr.nodes[index];
+    int left = node.left >= 0 ? compactNode(expr, node.left, out, copied) : -1;
+    int right = node.right >= 0 ? compactNode(expr, node.right, out, copied) : -1;
+
+    copied[index] = addNode(out, node.type, node.value, left, right);
+    return copied[index];
+}
+
+/* The method simplifies an expression; before/after receive the DAG sizes (see exprSize). */
+Expression simplifyExpr(Expression &expr, unsigned &before, unsigned &after)
+{
+    Expression work, result;
+    simplifyContext ctx = {&expr, &work, array<int>(), array<int>(), array<bool>()};
+    array<int> copied;
+
+    ctx.done.reserve(expr.nodes.length);
+    ctx.chainRoot.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+    {
+        ctx.done.push(-1);
+        ctx.chainRoot.push(false);
+    }
+
+    ctx.chainRoot[expr.root] = true;
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+    {
+        exprNode node = expr.nodes[i];
+        int kind = chainKind(node.type);
+
+        if (node.left >= 0 && (kind == 0 || chainKind(expr.nodes[node.left].type) != kind))
+            ctx.chainRoot[node.left] = true;
+        if (node.right >= 0 && (kind == 0 || chainKind(expr.nodes[node.right].type) != kind))
+            ctx.chainRoot[node.right] = true;
+    }
+
+    work.root = simplifyNode(ctx, expr.root);
+
+    copied.reserve(work.nodes.length);
+    for (unsigned i = 0; i < work.nodes.length; i++)
+        copied.push(-1);
+
+    result.root = compactNode(work, work.root, result, copied);
+
+    before = exprSize(expr);
+    after = exprSize(result);
+
+    return result;
+}
+
+Expression simplifyExpr(Expression &expr)
+{
+    unsigned before, after;
+    return simplifyExpr(expr, before, after);
+}
+
+/* The method runs one f^(n) round. raw is differentiated as is: its DAG shares nodes with every lower order.
+   simplified becomes the smaller of the simplified raw derivative and the simplified derivative of the
+   previous simplified result; before/after receive the raw and simplified sizes. */
+/* Note: neither chain alone wins, rewriting drops the sharing with lower orders that raw keeps,
+   while raw never collects terms, so trig-heavy chains shrink one way and quotients the other. */
+void diffRound(Expression &raw, Expression &simplified, unsigned &before, unsigned &after)
+{
+    unsigned size;
+
+    raw = diffExpr(raw);
+    Expression fromRaw = simplifyExpr(raw, before, after);
+
+    Expression next = diffExpr(simplified);
+    next = simplifyExpr(next, size, size);
+
+    simplified = size < after ? next : fromRaw;
+    if (size < after)
+        after = size;
+}
+
+#endif
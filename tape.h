@@ -0,0 +1,211 @@
+#ifndef TAPE_H
+#define TAPE_H
+
+/* Reverse-mode differentiation over x and y. recordTape lays the reachable nodes of an expression out once
+   as a list of operations; each tapeGradient call then runs one forward sweep (values and local partials)
+   and one backward sweep (adjoints), so the whole gradient costs a small constant times one evaluation,
+   however many variables there are. All per-evaluation numbers live in one arena that is reused. */
+
+/* one operation: result = type(a, b); a and b are tape indices, -1 when unused */
+struct tapeOp
+{
+    exprType type;
+    double value; // constant value, or base of log
+    int a;
+    int b;
+};
+
+struct gradTape
+{
+    array<tapeOp> ops;
+    array<double> arena; // per op: value, d/da, d/db, adjoint
+    int x;               // tape index of x, -1 if the expression has none
+    int y;
+};
+
+/* offsets into the arena, in units of ops.length */
+enum tapeColumn
+{
+    TAPE_VALUE,
+    TAPE_DA,
+    TAPE_DB,
+    TAPE_ADJOINT
+};
+
+int recordNode(gradTape &tape, Expression &expr, int index, array<int> &recorded)
+{
+    if (recorded[index] >= 0)
+        return recorded[index];
+
+    exprNode &node = expr.nodes[index];
+    tapeOp op = {node.type, node.value, -1, -1};
+
+    if (node.left >= 0)
+        op.a = recordNode(tape, expr, node.left, recorded);
+    if (node.right >= 0)
+        op.b = recordNode(tape, expr, node.right, recorded);
+
+    tape.ops.push(op);
+    recorded[index] = tape.ops.length - 1;
+
+    if (node.type == EXPR_X)
+        tape.x = recorded[index];
+    if (node.type == EXPR_Y)
+        tape.y = recorded[index];
+
+    return recorded[index];
+}
+
+/* The method records an expression onto a tape, reusing the tape's arena when it is large enough. */
+void recordTape(gradTape &tape, Expression &expr)
+{
+    array<int> recorded;
+
+    recorded.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+        recorded.push(-1);
+
+    tape.ops = array<tapeOp>();
+    tape.x = tape.y = -1;
+    recordNode(tape, expr, expr.root, recorded); // the root is the last op
+
+    tape.arena.reserve(4 * tape.ops.length);
+    while (tape.arena.length < 4 * tape.ops.length)
+        tape.arena.push(0);
+}
+
+/* The method evaluates the taped expression at (x, y) and returns it, with its partial derivatives in fx and fy.
+   The numbers of the sweeps go to arena, 4 * ops.length of them, so threads sharing a tape each bring their own. */
+double tapeGradient(gradTape &tape, double *arena, double x, double y, double &fx, double &fy)
+{
+    unsigned count = tape.ops.length;
+    double *value = arena + TAPE_VALUE * count;
+    double *da = arena + TAPE_DA * count;
+    double *db = arena + TAPE_DB * count;
+    double *adjoint = arena + TAPE_ADJOINT * count;
+
+    for (unsigned i = 0; i < count; i++) // forward: value and local partials of each op
+    {
+        tapeOp &op = tape.ops[i];
+        double a = op.a >= 0 ? value[op.a] : 0, b = op.b >= 0 ? value[op.b] : 0;
+        double v = 0, pa = 0, pb = 0;
+
+        switch (op.type)
+        {
+        case EXPR_CONST:
+            v = op.value;
+            break;
+        case EXPR_X:
+            v = x;
+            break;
+        case EXPR_Y:
+            v = y;
+            break;
+        case EXPR_ADD:
+            v = a + b;
+            pa = 1;
+            pb = 1;
+            break;
+        case EXPR_SUB:
+            v = a - b;
+            pa = 1;
+            pb = -1;
+            break;
+        case EXPR_MUL:
+            v = a * b;
+            pa = b;
+            pb = a;
+            break;
+        case EXPR_DIV:
+            v = a / b;
+            pa = 1 / b;
+            pb = -v / b;
+            break;
+        case EXPR_POW:
+            v = pow(a, b);
+            pa = b == 0 ? 0 : b * pow(a, b - 1);
+            pb = tape.ops[op.b].type == EXPR_CONST ? 0 : v * log(a); // ln(a) is NaN for a < 0 and unused then
+            break;
+        case EXPR_NEG:
+            v = -a;
+            pa = -1;
+            break;
+        case EXPR_SIN:
+            v = sin(a);
+            pa = cos(a);
+            break;
+        case EXPR_COS:
+            v = cos(a);
+            pa = -sin(a);
+            break;
+        case EXPR_TAN:
+            v = tan(a);
+            pa = 1 + v * v;
+            break;
+        case EXPR_COT:
+            v = 1 / tan(a);
+            pa = -(1 + v * v);
+            break;
+        case EXPR_SEC:
+            v = 1 / cos(a);
+            pa = v * tan(a);
+            break;
+        case EXPR_CSC:
+            v = 1 / sin(a);
+            pa = -v / tan(a);
+            break;
+        case EXPR_LN:
+            v = log(a);
+            pa = 1 / a;
+            break;
+        case EXPR_LOG:
+            v = log(a) / log(op.value);
+            pa = 1 / (a * log(op.value));
+            break;
+        }
+
+        value[i] = v;
+        da[i] = pa;
+        db[i] = pb;
+        adjoint[i] = 0;
+    }
+
+    adjoint[count - 1] = 1;
+    for (unsigned i = count; i-- > 0;) // backward: push each adjoint down to the operands
+    {
+        tapeOp &op = tape.ops[i];
+
+        if (adjoint[i] == 0)
+            continue;
+        if (op.a >= 0)
+            adjoint[op.a] += adjoint[i] * da[i];
+        if (op.b >= 0)
+            adjoint[op.b] += adjoint[i] * db[i];
+    }
+
+    fx = tape.x >= 0 ? adjoint[tape.x] : 0;
+    fy = tape.y >= 0 ? adjoint[tape.y] : 0;
+
+    return value[count - 1];
+}
+
+double tapeGradient(gradTape &tape, double x, double y, double &fx, double &fy)
+{
+    return tapeGradient(tape, &tape.arena[0], x, y, fx, fy);
+}
+
+/* The method calculates dy/dx of F(x, y) = 0 at (x, y) as -F_x/F_y in one forward and one backward sweep. */
+double implicitSlope(gradTape &tape, double *arena, double x, double y)
+{
+    double fx, fy;
+
+    tapeGradient(tape, arena, x, y, fx, fy);
+    return -fx / fy;
+}
+
+double implicitSlope(gradTape &tape, double x, double y)
+{
+    return implicitSlope(tape, &tape.arena[0], x, y);
+}
+
+#endif
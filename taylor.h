@@ -0,0 +1,298 @@
+#ifndef TAYLOR_H
+#define TAYLOR_H
+
+/* Forward-mode differentiation. Every node carries the truncated Taylor series of its value along the
+   line x = x0 + dx*t, y = y0 + dy*t:  c[0] + c[1]*t + ... + c[order]*t^order,  c[k] = (d/dt)^k f / k!.
+   One pass over the nodes in order gives f and its derivatives up to order without building a derivative
+   expression; order 1 is dual-number arithmetic. The cost is O(nodes * order^2). */
+
+/* a value and its directional derivative */
+struct dual
+{
+    double value;
+    double deriv;
+};
+
+/* exponents up to this are raised by repeated multiplication, which also works where u = 0 */
+const double TAYLOR_POW_MAX = 64;
+
+/* w = u*v; w must not alias u or v */
+void taylorMul(const double *u, const double *v, double *w, unsigned order)
+{
+    for (unsigned k = 0; k <= order; k++)
+    {
+        double sum = 0;
+        for (unsigned j = 0; j <= k; j++)
+            sum += u[j] * v[k - j];
+
+        w[k] = sum;
+    }
+}
+
+/* w = u/v; w must not alias u or v */
+void taylorDiv(const double *u, const double *v, double *w, unsigned order)
+{
+    for (unsigned k = 0; k <= order; k++)
+    {
+        double sum = u[k];
+        for (unsigned j = 1; j <= k; j++)
+            sum -= v[j] * w[k - j];
+
+        w[k] = sum / v[0];
+    }
+}
+
+/* w = exp(u) */
+void taylorExp(const double *u, double *w, unsigned order)
+{
+    w[0] = exp(u[0]);
+
+    for (unsigned k = 1; k <= order; k++)
+    {
+        double sum = 0;
+        for (unsigned j = 1; j <= k; j++)
+            sum += j * u[j] * w[k - j];
+
+        w[k] = sum / k;
+    }
+}
+
+/* w = ln(u) */
+void taylorLog(const double *u, double *w, unsigned order)
+{
+    w[0] = log(u[0]);
+
+    for (unsigned k = 1; k <= order; k++)
+    {
+        double sum = 0;
+        for (unsigned j = 1; j < k; j++)
+            sum += j * w[j] * u[k - j];
+
+        w[k] = (u[k] - sum / k) / u[0];
+    }
+}
+
+/* s = sin(u), c = cos(u), which need each other */
+void taylorSinCos(const double *u, double *s, double *c, unsigned order)
+{
+    s[0] = sin(u[0]);
+    c[0] = cos(u[0]);
+
+    for (unsigned k = 1; k <= order; k++)
+    {
+        double sumS = 0, sumC = 0;
+        for (unsigned j = 1; j <= k; j++)
+        {
+            sumS += j * u[j] * c[k - j];
+            sumC += j * u[j] * s[k - j];
+        }
+
+        s[k] = sumS / k;
+        c[k] = -sumC / k;
+    }
+}
+
+/* w = u^a for a constant a; scratch holds 3 series */
+void taylorPowConst(const double *u, double a, double *w, double *scratch, unsigned order)
+{
+    unsigned n = order + 1;
+
+    if (a == floor(a) && fabs(a) <= TAYLOR_POW_MAX) // by squaring, like powInt
+    {
+        double *base = scratch, *result = scratch + n, *next = scratch + 2 * n;
+        unsigned long long e = (unsigned long long)fabs(a);
+
+        for (unsigned k = 0; k < n; k++)
+        {
+            base[k] = u[k];
+            result[k] = k == 0;
+        }
+
+        while (e)
+        {
+            if (e & 1)
+            {
+                taylorMul(result, base, next, order);
+                for (unsigned k = 0; k < n; k++)
+                    result[k] = next[k];
+            }
+            if (e >>= 1)
+            {
+                taylorMul(base, base, next, order);
+                for (unsigned k = 0; k < n; k++)
+                    base[k] = next[k];
+            }
+        }
+
+        if (a >= 0)
+        {
+            for (unsigned k = 0; k < n; k++)
+                w[k] = result[k];
+        }
+        else
+        {
+            base[0] = 1;
+            for (unsigned k = 1; k < n; k++)
+                base[k] = 0;
+            taylorDiv(base, result, w, order);
+        }
+        return;
+    }
+
+    w[0] = pow(u[0], a);
+
+    for (unsigned k = 1; k <= order; k++) // from u*w' = a*u'*w
+    {
+        double sum = 0;
+        for (unsigned j = 1; j <= k; j++)
+            sum += ((a + 1) * j - k) * u[j] * w[k - j];
+
+        w[k] = sum / (k * u[0]);
+    }
+}
+
+/* The method expands every node reachable from the root in node order (children come first).
+   Node i's series is rows[i*(order+1) ...]; the root's is copied into coef. */
+void taylorExpand(Expression &expr, double x, double y, double dx, double dy, unsigned order, double *coef)
+{
+    unsigned n = order + 1;
+    array<bool> reachable;
+
+    reachable.reserve(expr.nodes.length);
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+        reachable.push(false);
+    countNodes(expr, expr.root, reachable);
+
+    double *rows = new double[(expr.nodes.length + 5) * n];
+    double *s = rows + expr.nodes.length * n, *c = s + n, *scratch = c + n; // 3 scratch series after s and c
+
+    for (unsigned i = 0; i < expr.nodes.length; i++)
+    {
+        if (!reachable[i])
+            continue;
+
+        exprNode &node = expr.nodes[i];
+        double *w = rows + i * n;
+        double *u = node.left >= 0 ? rows + node.left * n : NULL;
+        double *v = node.right >= 0 ? rows + node.right * n : NULL;
+
+        switch (node.type)
+        {
+        case EXPR_CONST:
+        case EXPR_X:
+        case EXPR_Y:
+            for (unsigned k = 0; k < n; k++)
+                w[k] = 0;
+
+            w[0] = node.type == EXPR_CONST ? node.value : node.type == EXPR_X ? x : y;
+            if (order > 0)
+                w[1] = node.type == EXPR_CONST ? 0 : node.type == EXPR_X ? dx : dy;
+            break;
+        case EXPR_ADD:
+            for (unsigned k = 0; k < n; k++)
+                w[k] = u[k] + v[k];
+            break;
+        case EXPR_SUB:
+            for (unsigned k = 0; k < n; k++)
+                w[k] = u[k] - v[k];
+            break;
+        case EXPR_NEG:
+            for (unsigned k = 0; k < n; k++)
+                w[k] = -u[k];
+            break;
+        case EXPR_MUL:
+            taylorMul(u, v, w, order);
+            break;
+        case EXPR_DIV:
+            taylorDiv(u, v, w, order);
+            break;
+        case EXPR_POW:
+        {
+            bool constant = true;
+            for (unsigned k = 1; k < n; k++)
+                constant = constant && v[k] == 0;
+
+            if (constant)
+                taylorPowConst(u, v[0], w, scratch, order);
+            else // u^v = exp(v*ln(u))
+            {
+                taylorLog(u, s, order);
+                taylorMul(v, s, c, order);
+                taylorExp(c, w, order);
+            }
+        }
+        break;
+        case EXPR_SIN:
+            taylorSinCos(u, w, c, order);
+            break;
+        case EXPR_COS:
+            taylorSinCos(u, s, w, order);
+            break;
+        case EXPR_TAN:
+            taylorSinCos(u, s, c, order);
+            taylorDiv(s, c, w, order);
+            break;
+        case EXPR_COT:
+            taylorSinCos(u, s, c, order);
+            taylorDiv(c, s, w, order);
+            break;
+        case EXPR_SEC:
+        case EXPR_CSC:
+            taylorSinCos(u, s, c, order);
+            for (unsigned k = 0; k < n; k++)
+                scratch[k] = k == 0;
+            taylorDiv(scratch, node.type == EXPR_SEC ? c : s, w, order);
+            break;
+        case EXPR_LN:
+            taylorLog(u, w, order);
+            break;
+        case EXPR_LOG:
+        {
+            double scale = 1 / log(node.value);
+
+            taylorLog(u, w, order);
+            for (unsigned k = 0; k < n; k++)
+                w[k] *= scale;
+        }
+        break;
+        }
+    }
+
+    for (unsigned k = 0; k < n; k++)
+        coef[k] = rows[expr.root * n + k];
+
+    delete[] rows;
+}
+
+/* The method computes f(x), f'(x), ..., f^(order)(x) into derivs in one pass. */
+void taylorDerivatives(Expression &expr, double x, unsigned order, double *derivs)
+{
+    double factorial = 1;
+
+    taylorExpand(expr, x, 0, 1, 0, order, derivs);
+
+    for (unsigned k = 1; k <= order; k++)
+    {
+        factorial *= k;
+        derivs[k] *= factorial;
+    }
+}
+
+/* The method evaluates F(x, y) and its derivative in the direction (dx, dy) with dual numbers. */
+dual dualEval(Expression &expr, double x, double y, double dx, double dy)
+{
+    double coef[2];
+    taylorExpand(expr, x, y, dx, dy, 1, coef);
+
+    dual result = {coef[0], coef[1]};
+    return result;
+}
+
+/* The method computes the partial derivatives F_x and F_y of F(x, y) at a point, one dual pass each. */
+void implicitPartials(Expression &expr, double x, double y, double &fx, double &fy)
+{
+    fx = dualEval(expr, x, y, 1, 0).deriv;
+    fy = dualEval(expr, x, y, 0, 1).deriv;
+}
+
+#endif
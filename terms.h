@@ -0,0 +1,75 @@
+#ifndef TERMS_H
+#define TERMS_H
+
+/* The method splits input expression into arrays of string */
+array<string> readExpr(string expr)
+{
+    array<string> terms;
+    array<string> operation;
+
+    unsigned leftPar = 0, rightPar = 0;
+
+    // pre-reading process
+    expr = expr.replace(" ", "");
+
+    // reading equation process
+    unsigned splitIndex = 0;
+    for (unsigned i = 0; i < expr.length; i++)
+    {
+        if (expr[i] == '(')
+            leftPar++;
+        else if (expr[i] == ')')
+            rightPar++;
+
+        if ((expr[i] == '+' || expr[i] == '-') && expr[i - 1] != '^' && leftPar == rightPar)
+        {
+            terms.push(expr.slice(splitIndex, i));
+            splitIndex = i + (expr[i] == '+' ? 1 : 0);
+
+            if (expr[i] == '+')
+                operation.push("+");
+            if (expr[i] == '-')
+                operation.push("-");
+        }
+
+        if (i >= expr.length - 1)
+        {
+            terms.push(expr.slice(splitIndex, expr.length));
+        }
+    }
+
+    // check for errors
+    if (leftPar != rightPar)
+        throw "Bad arithmetic expression: no complete pair of parentheses ['()'].";
+
+    return terms;
+}
+
+/* The method classify what operation btw each term*/
+array<string> operation(string term)
+{
+    array<string> term_sep;
+    int leftPar = 0, rightPar = 0;
+
+    for (int i = 0; i < term.length; i++)
+    {
+        if (term[i] == ')')
+            rightPar++;
+        if (term[i] == '(')
+            leftPar++;
+        if (leftPar == rightPar)
+        {
+            if (term[i] == '+')
+                term_sep.push("+");
+            if (term[i] == '-')
+                term_sep.push("-");
+            if (term[i] == '*')
+                term_sep.push("*");
+            if (term[i] == '/')
+                term_sep.push("/");
+        }
+    }
+    return term_sep;
+}
+
+#endif